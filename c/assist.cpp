@@ -0,0 +1,185 @@
+///////////////////////////////////////////////////////////////////////////////////////////////
+// Homemade GPS Receiver
+// Copyright (c) Andrew Holme 2011-2013
+// http://www.holmea.demon.co.uk/GPS/Main.htm
+///////////////////////////////////////////////////////////////////////////////////////////////
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+
+#include "gps_offline.h"
+#include "ephemeris.h"
+#include "assist.h"
+
+#define WGS84_A     (6378137.0)
+#define WGS84_E2    (0.00669437999014132)
+
+#define LEAP_SECONDS 18 // GPS - UTC since 2017
+
+///////////////////////////////////////////////////////////////////////////////////////////////
+
+struct RECORD {
+    int prn;
+    double t_oe;
+    EPHEM eph;
+};
+
+static RECORD *Records;
+static int NumRecords;
+
+static double rx_xyz[3], rx_up[3];  // Receiver ECEF; local vertical
+
+///////////////////////////////////////////////////////////////////////////////////////////////
+
+static long Days(int y, int m, int d) { // since 1970-01-01, proleptic Gregorian
+    y -= m<=2;
+    long era = (y>=0? y : y-399) / 400;
+    long yoe = y - era*400;
+    long doy = (153*(m>2? m-3 : m+9) + 2)/5 + d-1;
+    long doe = yoe*365 + yoe/4 - yoe/100 + doy;
+    return era*146097 + doe - 719468;
+}
+
+static double SecondsOfWeek(int y, int m, int d, int hh, int mm, double ss) {
+    long days = Days(y, m, d) - Days(1980, 1, 6); // GPS epoch, a Sunday
+    return (days%7)*86400.0 + hh*3600 + mm*60 + ss;
+}
+
+double AssistTime(const char *s) { // "YYYY-MM-DDTHH:MM:SS" UTC, seconds of week, or NULL = now
+    int y, m, d, hh, mm;
+    double ss;
+    char *end;
+
+    if (!s) {
+        double days = time(NULL)/86400.0 - Days(1980, 1, 6);
+        return fmod(days*86400 + LEAP_SECONDS, 604800);
+    }
+
+    if (sscanf(s, "%d-%d-%d%*c%d:%d:%lf", &y, &m, &d, &hh, &mm, &ss)==6)
+        return fmod(SecondsOfWeek(y, m, d, hh, mm, ss) + LEAP_SECONDS, 604800);
+
+    double t = strtod(s, &end);
+    return *end || t<0 || t>=604800? -1 : t;
+}
+
+double AssistUnixTime(const char *s) { // "YYYY-MM-DDTHH:MM:SS" UTC as Unix time, <0 = NULL or seconds of week
+    int y, m, d, hh, mm;
+    double ss;
+
+    if (!s || sscanf(s, "%d-%d-%d%*c%d:%d:%lf", &y, &m, &d, &hh, &mm, &ss)!=6) return -1;
+    return Days(y, m, d)*86400.0 + hh*3600 + mm*60 + ss;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////
+
+static double Field(const char *line, int col) { // D19.12 at col, Fortran exponent
+    char s[20];
+    int n = strlen(line);
+    if (col>=n) return 0;
+    snprintf(s, sizeof s, "%.19s", line+col);
+    for (char *p=s; *p; p++) if (*p=='D' || *p=='d') *p='E';
+    return atof(s);
+}
+
+int AssistLoad(const char *rinex) {
+    char line[256];
+    double version=0;
+    int cap=0;
+
+    FILE *fp = fopen(rinex, "r");
+    if (!fp) return -1;
+
+    while (fgets(line, sizeof line, fp)) {
+        if (strstr(line, "RINEX VERSION")) version = atof(line);
+        if (strstr(line, "END OF HEADER")) break;
+    }
+
+    // RINEX 2: "PP YY MM DD HH MM SS.S" then fields at 22; 3: "Gnn YYYY ..." at 23
+    int v3 = version>=3, col0 = v3? 4 : 3;
+
+    while (fgets(line, sizeof line, fp)) {
+        int prn, y, m, d, hh, mm;
+        double ss, v[29]={0};
+        bool ok;
+
+        if (v3) ok = line[0]=='G' && sscanf(line+1, "%d %d %d %d %d %d %lf", &prn, &y, &m, &d, &hh, &mm, &ss)==7;
+        else    ok = sscanf(line, "%d %d %d %d %d %d %lf", &prn, &y, &m, &d, &hh, &mm, &ss)==7;
+        if (!ok) continue; // other systems' records are skipped a line at a time
+        if (y<100) y += y<80? 2000 : 1900;
+
+        for (int i=0; i<3; i++) v[i] = Field(line, col0+19+19*i);
+        for (int i=0; i<7; i++) {
+            if (!fgets(line, sizeof line, fp)) break;
+            for (int j=0; j<4 && 3+4*i+j<29; j++) v[3+4*i+j] = Field(line, col0+19*j);
+        }
+
+        if (prn<1 || prn>NUM_SATS || v[24]!=0) continue; // unhealthy
+
+        if (NumRecords==cap) {
+            cap = cap? cap*2 : 64;
+            Records = (RECORD *) realloc(Records, cap*sizeof(RECORD));
+            if (!Records) return -2;
+        }
+        RECORD *r = Records + NumRecords++;
+        r->prn = prn;
+        r->t_oe = v[11];
+        r->eph.Rinex(SecondsOfWeek(y, m, d, hh, mm, ss), v);
+    }
+
+    fclose(fp);
+    return NumRecords;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////
+
+void AssistPosition(double lat, double lon, double alt) {
+    lat *= PI/180;
+    lon *= PI/180;
+
+    double N = WGS84_A/sqrt(1-WGS84_E2*sin(lat)*sin(lat));
+
+    rx_xyz[0] = (N+alt)*cos(lat)*cos(lon);
+    rx_xyz[1] = (N+alt)*cos(lat)*sin(lon);
+    rx_xyz[2] = (N*(1-WGS84_E2)+alt)*sin(lat);
+
+    rx_up[0] = cos(lat)*cos(lon);
+    rx_up[1] = cos(lat)*sin(lon);
+    rx_up[2] = sin(lat);
+}
+
+static double Age(double t, double t_oe) { // |t - t_oe| across week rollover
+    double dt = fabs(t - t_oe);
+    return dt>302400? 604800-dt : dt;
+}
+
+bool AssistPredict(int prn, double t, double *elev, double *doppler) {
+    RECORD *best=NULL;
+
+    for (int i=0; i<NumRecords; i++)
+        if (Records[i].prn==prn && (!best || Age(t, Records[i].t_oe) < Age(t, best->t_oe)))
+            best = Records+i;
+    if (!best) return false;
+
+    // Line of sight, and range rate by finite difference (receiver fixed in ECEF)
+    double p0[3], p1[3], u[3], r=0, rr=0, up=0;
+    best->eph.GetXYZ(p0, p0+1, p0+2, t);
+    best->eph.GetXYZ(p1, p1+1, p1+2, t+1);
+
+    for (int i=0; i<3; i++) {
+        u[i] = p0[i]-rx_xyz[i];
+        r += u[i]*u[i];
+    }
+    r = sqrt(r);
+    for (int i=0; i<3; i++) {
+        u[i] /= r;
+        rr += (p1[i]-p0[i]) * u[i];
+        up += u[i] * rx_up[i];
+    }
+
+    *elev = asin(up)*180/PI;
+    *doppler = -rr*L1/C;
+    return true;
+}
@@ -0,0 +1,17 @@
+///////////////////////////////////////////////////////////////////////////////////////////////
+// Homemade GPS Receiver
+// Copyright (c) Andrew Holme 2011-2013
+// http://www.holmea.demon.co.uk/GPS/Main.htm
+///////////////////////////////////////////////////////////////////////////////////////////////
+
+///////////////////////////////////////////////////////////////////////////////////////////////
+// Assisted acquisition: broadcast ephemerides from a RINEX navigation file, plus an
+// approximate receiver position and GPS time, predict which SVs are up and their Doppler.
+
+int    AssistLoad(const char *rinex);                       // Returns records loaded, <0 = error
+void   AssistPosition(double lat, double lon, double alt);  // Degrees, degrees, metres
+double AssistTime(const char *s);                           // GPS seconds of week (NULL = now), <0 = bad format
+double AssistUnixTime(const char *s);                       // Same as Unix time, <0 = NULL or seconds of week
+
+// Elevation (degrees) and Doppler (Hz) of GPS prn at t seconds of week; false if no ephemeris
+bool   AssistPredict(int prn, double t, double *elev, double *doppler);
@@ -0,0 +1,448 @@
+///////////////////////////////////////////////////////////////////////////////////////////////
+// Homemade GPS Receiver
+// Copyright (c) Andrew Holme 2011-2013
+// http://www.holmea.demon.co.uk/GPS/Main.htm
+///////////////////////////////////////////////////////////////////////////////////////////////
+
+// gps_bench: times each stage of acquisition and the navigation solution in
+// isolation, so a change to one stage can be measured without the others.
+// The search engine's stages are reached through search_internal.h.
+
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <fftw3.h>
+#include <math.h>
+
+#include "gps_offline.h"
+#include "cacode.h"
+#include "simd.h"
+#include "source.h"
+#include "search_internal.h"
+#include "ephemeris.h"
+#include "solution.h"
+#include "nav.h"
+
+double FC = 2.046e6, FS = 8.184e6, max_fo = 5000;
+int snapshot;
+int threads;
+int trackers;
+int channels;
+int batch = 4;
+int noncoh = 1;
+int coarse = 1;
+double start_time, duration;
+char *cache_dir;
+unsigned planner = FFTW_ESTIMATE;
+char *prns;
+char *aid_file, *aid_time;
+double aid_lat, aid_lon, aid_alt;
+double aid_window = 1000;
+double aid_mask = 5;
+char *warm_file;
+FORMAT format = FMT_1BIT;
+
+///////////////////////////////////////////////////////////////////////////////////////////////
+// Results
+
+struct RESULT {
+    char name[32];
+    double ns;                      // Per operation
+    double samples, bins;           // Per operation, 0 = n/a
+};
+
+#define MAX_RESULTS 64
+
+static RESULT Results[MAX_RESULTS];
+static int NumResults;
+
+static double min_time = 0.2;       // Seconds per measurement
+
+static void Report(const char *name, double secs, double samples, double bins) {
+    RESULT *r = Results + NumResults;
+    if (NumResults==MAX_RESULTS) return;
+    NumResults++;
+
+    snprintf(r->name, sizeof r->name, "%s", name);
+    r->ns = secs*1e9;
+    r->samples = samples;
+    r->bins = bins;
+
+    printf("%-28s %14.1f", name, r->ns);
+    if (samples) printf(" %12.2f", samples/secs/1e6); else printf(" %12s", "");
+    if (bins)    printf(" %12.0f", bins/secs);        else printf(" %12s", "");
+    printf("\n");
+}
+
+static void Json(const char *path, const char *simd) {
+    FILE *fp = fopen(path, "w");
+    if (!fp) {
+        printf("can not write %s\n", path);
+        return;
+    }
+    fprintf(fp, "{\n");
+    fprintf(fp, "  \"fft_len\": %d,\n  \"fs\": %.0f,\n  \"fc\": %.0f,\n", FFT_LEN, FS, FC);
+    fprintf(fp, "  \"threads\": %d,\n  \"batch\": %d,\n  \"dec\": %d,\n", NumWorkers, batch, DEC);
+    fprintf(fp, "  \"simd\": \"%s\",\n  \"results\": [\n", simd);
+    for (int i=0; i<NumResults; i++) {
+        RESULT *r = Results+i;
+        fprintf(fp, "    {\"name\": \"%s\", \"ns_per_op\": %.1f", r->name, r->ns);
+        if (r->samples) fprintf(fp, ", \"samples_per_s\": %.0f", r->samples/r->ns*1e9);
+        if (r->bins)    fprintf(fp, ", \"bins_per_s\": %.0f", r->bins/r->ns*1e9);
+        fprintf(fp, "}%s\n", i+1<NumResults? "," : "");
+    }
+    fprintf(fp, "  ]\n}\n");
+    fclose(fp);
+}
+
+// Repeat OP, doubling the count, until it has run for min_time; one warm-up call first
+#define BENCH(NAME, SAMPLES, BINS, OP) {                        \
+    OP;                                                         \
+    long b_done=0, b_reps=1;                                    \
+    double b_t0=Seconds(), b_t;                                 \
+    for (;;) {                                                  \
+        for (long b_rep=0; b_rep<b_reps; b_rep++) { OP; }       \
+        b_done += b_reps;                                       \
+        if ((b_t=Seconds()-b_t0) >= min_time) break;            \
+        b_reps *= 2;                                            \
+    }                                                           \
+    Report(NAME, b_t/b_done, SAMPLES, BINS);                    \
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////
+// Down-convert and forward FFT
+
+static void BenchSample(const char *capture) {
+    static const char *names[] = {"1bit", "2bit", "rtl", "hackrf", "int16"};
+    char name[32];
+
+    // Worst case: FFT_LEN 32-bit samples
+    unsigned char *rnd = (unsigned char *) malloc(FFT_LEN*4);
+    srand(1);
+    for (int i=0; i<FFT_LEN*4; i++) rnd[i] = rand();
+
+    for (int f=0; f<FMT_INT16+1; f++) {
+        sprintf(name, "unpack/%s", names[f]);
+        BENCH(name, FFT_LEN, 0, Formats[f].decode(fwd_buf, rnd));
+    }
+
+    SOURCE src;
+    if (src.Open(capture, 1)==0) {
+        const unsigned char *rx = src.View(FFT_LEN/8, 0);
+        if (rx) BENCH("unpack/1bit capture", FFT_LEN, 0, Decode1(fwd_buf, rx));
+        src.Close();
+    }
+    else
+        printf("%-28s %s not found\n", "unpack/1bit capture", capture);
+
+    BENCH("fft/forward", FFT_LEN, 0, fftwf_execute_dft(fwd_plan, fwd_buf, fwd_buf));
+
+    // Leave a real capture block in fwd_buf for the correlator, else noise
+    if (src.Open(capture, 1)==0) {
+        Capture(src);
+        src.Close();
+    }
+    else {
+        Decode1(fwd_buf, rnd);
+        fftwf_execute_dft(fwd_plan, fwd_buf, fwd_buf);
+    }
+
+    free(rnd);
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////
+// Correlator stages on one worker, then whole sweeps on all of them
+
+static void BenchCorrelate() {
+    const int max_bin = int(max_fo*FFT_LEN/FS);
+    WORKER &w = Workers[0];
+    int svs[CA_PRNS], dop[CA_PRNS], peak[CA_PRNS];
+    float snr[CA_PRNS];
+
+    BENCH("code/spectrum", FFT_LEN, 0,
+          fftwf_free(code[0]); code[0]=NULL; CodeSpectrum(0));
+
+    for (int sv=0; sv<NumSats; sv++) CodeSpectrum(svs[sv]=sv);
+
+    job_sv[0] = 0;
+    job_dop[0] = -max_bin;
+    job_bins = 2*max_bin + 1;
+    job_blks = (job_bins+batch-1)/batch;
+
+    for (job_dec=1; ; job_dec=DEC) {
+        const char *s = job_dec==1? "" : "/coarse";
+        char name[32];
+        int len = FFT_LEN/job_dec;
+
+        sprintf(name, "corr/products%s", s);
+        BENCH(name, len*batch, batch, w.Products(0, 0, batch, fwd_buf));
+        sprintf(name, "corr/inverse%s", s);
+        BENCH(name, len*batch, batch, w.Inverse(batch));
+        sprintf(name, "corr/peak%s", s);
+        BENCH(name, len*batch, batch, w.Accumulate(batch, 0); w.Peak(0, 0, batch));
+        sprintf(name, "corr/item%s", s);
+        BENCH(name, len*batch, batch, w.Correlate(0));
+
+        if (job_dec==DEC) break;
+    }
+
+    // Whole Doppler range, all SVs, all workers
+    int dec = DEC;
+    DEC = 1;
+    BENCH("sweep/single", 0, NumSats*job_bins, Correlate(NumSats, svs, 0, snr, dop, peak));
+    DEC = dec;
+    if (DEC>1) BENCH("sweep/two-stage", 0, NumSats*job_bins, Correlate(NumSats, svs, 0, snr, dop, peak));
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////
+// Software tracking channels, all busy, 1 ms of noise at a time
+
+static void Refill() { // free channels onto the next PRNs
+    static int sv;
+    for (int ch; (ch=ChanReset())>=0; sv=(sv+1)%NUM_SATS) ChanStart(ch, sv, 0, 0);
+}
+
+static void BenchTrack() {
+    const int n = (int(FS/1000)+7)/8*8;
+    unsigned char *rnd = (unsigned char *) malloc(n/8);
+    for (int i=0; i<n/8; i++) rnd[i] = rand();
+
+    int nt = ChanInit(n);
+    if (nt<0) {
+        printf("ChanInit() returned %d\n", nt);
+        free(rnd);
+        return;
+    }
+
+    // Noise: lock detectors free channels, so refill them every 100 ms of samples
+    const int BLKS = 100;
+    Refill();
+
+    // Trackers run behind the bus: the ring fills, then the producer runs at their pace
+    char name[32];
+    sprintf(name, "track/chans%d/threads%d", channels, nt);
+    double t0 = Seconds();
+    long blks = 0;
+    BENCH(name, n*BLKS, 0, for (int b=0; b<BLKS; b++) ChanSamples(rnd, n); ChanSync(); Refill(); blks+=BLKS);
+
+    printf("%-28s %.1f x real time\n", "", blks*n/FS / (Seconds()-t0));
+    ChanFree();
+    free(rnd);
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////
+// Synthetic constellation: ephemerides encoded as subframes, replicas for a known position
+
+static void Field(char *nav, int bit, int len, int64_t val) { // MSB first from nav bit
+    for (int i=len-1; i>=0; i--, bit++) {
+        char mask = 0x80 >> (bit&7);
+        if ((val>>i)&1) nav[bit>>3] |= mask; else nav[bit>>3] &= ~mask;
+    }
+}
+
+static int64_t Scale(double val, int exp2) {
+    return int64_t(floor(val/pow(2, exp2) + 0.5));
+}
+
+static void Pack(unsigned *sub, const char *nav) { // 30 data bytes to ten words, parity zero
+    for (int w=0; w<10; w++, nav+=3)
+        sub[w] = (nav[0]&0xFF)<<22 | (nav[1]&0xFF)<<14 | (nav[2]&0xFF)<<6;
+}
+
+static void Ephem(EPHEM &eph, int sv, unsigned tow) {
+    char nav[30];
+    unsigned sub[10];
+    int plane = sv%6, slot = sv/6;
+
+    for (int id=1; id<=3; id++) {
+        memset(nav, 0, sizeof nav);
+        Field(nav, 24, 17, tow);
+        Field(nav, 43, 3, id);
+        switch (id) {
+            case 1:
+                Field(nav, 8*6,  10, 800);                          // week
+                Field(nav, 8*21,  8, 77);                           // IODC
+                Field(nav, 8*22, 16, 302400>>4);                    // t_oc
+                Field(nav, 8*27, 22, Scale(10e-6*(sv%3-1), -31));   // a_f0
+                break;
+            case 2:
+                Field(nav, 8*6,   8, 77);                           // IODE
+                Field(nav, 8*9,  16, Scale(1.5e-9, -43));           // dn
+                Field(nav, 8*11, 32, Scale(0.1*plane+0.33*slot-0.9, -31)); // M_0
+                Field(nav, 8*17, 32, Scale(0.005, -33));            // e
+                Field(nav, 8*23, 32, Scale(5153.7, -19));           // sqrtA
+                Field(nav, 8*27, 16, 302400>>4);                    // t_oe
+                break;
+            case 3:
+                Field(nav, 8*8,  32, Scale(plane/3.0-1, -31));      // OMEGA_0
+                Field(nav, 8*14, 32, Scale(0.31, -31));             // i_0
+                Field(nav, 8*20, 32, Scale(0.2, -31));              // omega
+                Field(nav, 8*24, 24, Scale(-2.6e-9, -43));          // OMEGA_dot
+                Field(nav, 8*27,  8, 77);                           // IODE
+                break;
+        }
+        Pack(sub, nav);
+        eph.Subframe(sub);
+    }
+}
+
+// Replica for a signal transmitted at t_sv (satellite clock, seconds of week)
+static void Replica(SNAPSHOT &rep, int sv, double t_sv) {
+    rep.sv = sv;
+    rep.power = 1;
+    rep.eph.tow = unsigned(t_sv/6);
+    t_sv -= rep.eph.tow*6.0;
+    rep.bits = int(t_sv*BPS);
+    t_sv -= rep.bits/BPS;
+    rep.ms = int(t_sv*1e3);
+    t_sv -= rep.ms*1e-3;
+    int chips = int(t_sv*CPS);
+    rep.ca_phase = int((t_sv-chips/CPS)*CPS*64);
+
+    rep.g1 = CaTable.g1_state[chips];
+}
+
+static void BenchSolve() {
+    const double t_rx = 302500, lat = 52.95*PI/180, lon = -1.15*PI/180, alt = 50;
+    const double a = 6378137.0, e2 = 0.00669437999014132;
+    double x, y, z, t_bias;
+    SNAPSHOT reps[NUM_SATS];
+    int n=0;
+
+    // Receiver in ECEF
+    double N = a/sqrt(1-e2*sin(lat)*sin(lat));
+    double rx = (N+alt)*cos(lat)*cos(lon),
+           ry = (N+alt)*cos(lat)*sin(lon),
+           rz = (N*(1-e2)+alt)*sin(lat);
+    double r = sqrt(rx*rx + ry*ry + rz*rz);
+
+    for (int sv=0; sv<NUM_SATS; sv++) {
+        SNAPSHOT &rep = reps[n];
+        Ephem(rep.eph, sv, unsigned(t_rx/6));
+
+        // Light time, with earth rotation as Solve() applies it
+        double t_tx = t_rx, dx, dy, dz;
+        for (int i=0; i<4; i++) {
+            rep.eph.GetXYZ(&x, &y, &z, t_tx);
+            double theta = (t_tx - t_rx) * OMEGA_E;
+            dx = x*cos(theta) - y*sin(theta) - rx;
+            dy = x*sin(theta) + y*cos(theta) - ry;
+            dz = z - rz;
+            t_tx = t_rx - sqrt(dx*dx + dy*dy + dz*dz)/C;
+        }
+
+        // Above 10 degrees elevation only
+        if ((dx*rx + dy*ry + dz*rz)/r < sin(10*PI/180)*sqrt(dx*dx + dy*dy + dz*dz)) continue;
+
+        Replica(rep, sv, t_tx + rep.eph.GetClockCorrection(t_tx));
+        n++;
+    }
+
+    if (n<4) {
+        printf("solve: only %d SVs visible\n", n);
+        return;
+    }
+
+    int t = 0;
+    unsigned g1[64];
+    for (int i=0; i<64; i++) g1[i] = CaTable.g1_state[(i*12345)%CA_LEN];
+    BENCH("nav/searchcode", 0, 0, t=(t+1)&63; SearchCode(t%NUM_SATS, g1[t]));
+
+    BENCH("nav/getxyz", 0, 0, t=(t+1)&1023; reps[0].eph.GetXYZ(&x, &y, &z, t_rx+t));
+
+    char name[32];
+    sprintf(name, "nav/solve%d", n);
+    int iter = Solve(reps, n, &x, &y, &z, &t_bias);
+    BENCH(name, 0, 0, Solve(reps, n, &x, &y, &z, &t_bias));
+
+    printf("%-28s %d iterations, %.3f m from truth\n", "",
+        iter, sqrt((x-rx)*(x-rx) + (y-ry)*(y-ry) + (z-rz)*(z-rz)));
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////
+
+// 24 data bits to the 30-bit word sent after one ending in prev: inverted if its D30 is set
+static uint32_t Encode(uint32_t prev, uint32_t data) {
+    uint32_t w = (prev&3)<<30 | data<<6;
+    w |= NavParity(w);
+    return prev&1? w ^ 0x3FFFFFC0 : w;
+}
+
+static void BenchNav() {
+    const int SUBS = 10;
+    static char bits[SUBS*300];
+    uint32_t prev=0;
+
+    // Random subframes with correct parity, t bits solved for D29 = D30 = 0 as sent
+    srand(2);
+    for (int k=0; k<SUBS; k++)
+        for (int w=0; w<10; w++) {
+            uint32_t data = w? rand() & 0xFFFFFF : 0x8B0000 | (rand() & 0xFFFF);
+            if (w==1 || w==9) {
+                uint32_t t=0;
+                while (t<3 && (Encode(prev, (data&~3u)|t)&3)) t++;
+                data = (data&~3u)|t;
+            }
+            prev = Encode(prev, data);
+            for (int i=0; i<30; i++) bits[k*300+w*30+i] = prev>>(29-i) & 1;
+        }
+
+    NAV_DECODER dec;
+    dec.Reset();
+    int n=0, subs=0;
+    BENCH("nav/subframe", 0, 0, for (int i=0; i<300; i++, n=(n+1)%(SUBS*300)) subs += NAV_OK==dec.Push(bits[n]));
+    if (!subs) printf("nav/subframe: nothing decoded\n");
+
+    // Phase ambiguity: the same stream inverted decodes the same
+    int inv=0;
+    dec.Reset();
+    for (int i=0; i<SUBS*300; i++) inv += NAV_OK==dec.Push(!bits[i]);
+    if (inv!=SUBS) printf("nav/subframe: %d of %d inverted subframes\n", inv, SUBS);
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////
+
+int main(int argc, char *argv[]) {
+    const char *capture = "gps_sig_tmp.bin";
+    const char *json = NULL;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "j:J:C:k:t:o:P:")) != -1) {
+      switch (opt) {
+        case 'j': threads = atoi(optarg); break;
+        case 'J': trackers = atoi(optarg); break;
+        case 'C': channels = atoi(optarg); break;
+        case 'k': batch = atoi(optarg); break;
+        case 't': min_time = atof(optarg); break;
+        case 'o': json = optarg; break;
+        case 'P': prns = optarg; break;
+        default:
+          printf("usage: gps_bench [-j threads] [-J trackers] [-C channels] [-k batch] [-P prns] [-t seconds] [-o results.json] [capture FC FS]\n");
+          return(0);
+      }
+    }
+    if (optind<argc) capture = argv[optind++];
+    if (optind<argc) FC = atof(argv[optind++]);
+    if (optind<argc) FS = atof(argv[optind++]);
+
+    double t0 = Seconds();
+    int ret = SearchInit();
+    if (ret) {
+        printf("SearchInit() returned %d\n", ret);
+        return(ret);
+    }
+
+    printf("%-28s %14s %12s %12s\n", "", "ns/op", "MSa/s", "bins/s");
+    Report("search/init", Seconds()-t0, 0, 0);
+    BenchSample(capture);
+    BenchCorrelate();
+    BenchTrack();
+    BenchNav();
+    BenchSolve();
+
+    if (json) Json(json, simd_name);
+
+    SearchFree();
+    return(0);
+}
@@ -4,32 +4,141 @@
 // http://www.holmea.demon.co.uk/GPS/Main.htm
 ///////////////////////////////////////////////////////////////////////////////////////////////
 
-#include <memory.h>
-
-struct CACODE {
-   char g1[11], g2[11], *tap[2];
-
-   CACODE(int t0, int t1) {
-      tap[0] = g2+t0;
-      tap[1] = g2+t1;
-      memset(g1+1, 1, 10);
-      memset(g2+1, 1, 10);
-   }
-
-   int Chip() {
-      return g1[10] ^ *tap[0] ^ *tap[1];
-   }
-
-   void Clock() {
-      g1[0] = g1[3] ^ g1[10];
-      g2[0] = g2[2] ^ g2[3] ^ g2[6] ^ g2[8] ^ g2[9] ^ g2[10];
-      memmove(g1+1, g1, 10);
-      memmove(g2+1, g2, 10);
-   }
-
-   unsigned GetG1() {
-      unsigned ret=0;
-      for (int bit=0; bit<10; bit++) ret += ret + g1[10-bit];
-      return ret;
-   }
+#include <stdint.h>
+
+///////////////////////////////////////////////////////////////////////////////////////////////
+// C/A Gold codes, built by the compiler (C++14 constexpr) rather than by clocking
+// shift registers at run time.
+//
+// G1 = 1 + x^3 + x^10, G2 = 1 + x^2 + x^3 + x^6 + x^8 + x^9 + x^10, both reset to all ones.
+// A register state is a 10-bit word, bit n-1 = stage n, as uploaded by the FPGA.
+
+#define CA_LEN    1023              // Chips per code period
+#define CA_WORDS  16                // 64-bit words per packed code, chip i = bit i%64 of word i/64
+#define CA_PRNS   76                // Signal catalogue entries
+
+// Signal catalogue: each code is G2 delayed by delay chips (IS-GPS-200, DO-229).
+// GPS PRNs also have the equivalent pair of G2 taps, as the FPGA code generator
+// takes; PRN 34 and 37 share a code.
+struct CA_SIGNAL {
+    int prn;
+    int delay;                      // G2 delay, chips
+    int t1, t2;                     // G2 taps, 0 = none
 };
+
+constexpr CA_SIGNAL CaSignals[CA_PRNS] = {
+    // GPS
+    {  1,    5,  2,  6},
+    {  2,    6,  3,  7},
+    {  3,    7,  4,  8},
+    {  4,    8,  5,  9},
+    {  5,   17,  1,  9},
+    {  6,   18,  2, 10},
+    {  7,  139,  1,  8},
+    {  8,  140,  2,  9},
+    {  9,  141,  3, 10},
+    { 10,  251,  2,  3},
+    { 11,  252,  3,  4},
+    { 12,  254,  5,  6},
+    { 13,  255,  6,  7},
+    { 14,  256,  7,  8},
+    { 15,  257,  8,  9},
+    { 16,  258,  9, 10},
+    { 17,  469,  1,  4},
+    { 18,  470,  2,  5},
+    { 19,  471,  3,  6},
+    { 20,  472,  4,  7},
+    { 21,  473,  5,  8},
+    { 22,  474,  6,  9},
+    { 23,  509,  1,  3},
+    { 24,  512,  4,  6},
+    { 25,  513,  5,  7},
+    { 26,  514,  6,  8},
+    { 27,  515,  7,  9},
+    { 28,  516,  8, 10},
+    { 29,  859,  1,  6},
+    { 30,  860,  2,  7},
+    { 31,  861,  3,  8},
+    { 32,  862,  4,  9},
+    { 33,  863,  5, 10},
+    { 34,  950,  4, 10},
+    { 35,  947,  1,  7},
+    { 36,  948,  2,  8},
+    { 37,  950,  4, 10},
+    // SBAS
+    {120,  145,  0,  0},
+    {121,  175,  0,  0},
+    {122,   52,  0,  0},
+    {123,   21,  0,  0},
+    {124,  237,  0,  0},
+    {125,  235,  0,  0},
+    {126,  886,  0,  0},
+    {127,  657,  0,  0},
+    {128,  634,  0,  0},
+    {129,  762,  0,  0},
+    {130,  355,  0,  0},
+    {131, 1012,  0,  0},
+    {132,  176,  0,  0},
+    {133,  603,  0,  0},
+    {134,  130,  0,  0},
+    {135,  359,  0,  0},
+    {136,  595,  0,  0},
+    {137,   68,  0,  0},
+    {138,  386,  0,  0},
+    {139,  797,  0,  0},
+    {140,  456,  0,  0},
+    {141,  499,  0,  0},
+    {142,  883,  0,  0},
+    {143,  307,  0,  0},
+    {144,  127,  0,  0},
+    {145,  211,  0,  0},
+    {146,  121,  0,  0},
+    {147,  118,  0,  0},
+    {148,  163,  0,  0},
+    {149,  628,  0,  0},
+    {150,  853,  0,  0},
+    {151,  484,  0,  0},
+    {152,  289,  0,  0},
+    {153,  811,  0,  0},
+    {154,  202,  0,  0},
+    {155, 1021,  0,  0},
+    {156,  463,  0,  0},
+    {157,  568,  0,  0},
+    {158,  904,  0,  0}
+};
+
+constexpr unsigned G1Next(unsigned s) { return (s<<1 & 0x3FF) | ((s>>2 ^ s>>9) & 1); }
+constexpr unsigned G2Next(unsigned s) { return (s<<1 & 0x3FF) | ((s>>1 ^ s>>2 ^ s>>5 ^ s>>7 ^ s>>8 ^ s>>9) & 1); }
+
+struct CA_TABLE {
+    uint64_t code[CA_PRNS][CA_WORDS];   // [CaSignals index] packed chips
+    uint16_t g1_state[CA_LEN];          // G1 state at chip i
+    int16_t  g1_chip[1024];             // Inverse: chip index of G1 state, -1 = never (0)
+
+    constexpr CA_TABLE() : code(), g1_state(), g1_chip() {
+        uint16_t g2_state[CA_LEN] = {};
+
+        for (unsigned i=0, g1=0x3FF, g2=0x3FF; i<CA_LEN; i++, g1=G1Next(g1), g2=G2Next(g2)) {
+            g1_state[i] = g1;
+            g2_state[i] = g2;
+        }
+
+        g1_chip[0] = -1;
+        for (int i=0; i<CA_LEN; i++)
+            g1_chip[g1_state[i]] = i;
+
+        for (int k=0; k<CA_PRNS; k++)
+            for (int i=0; i<CA_LEN; i++) {
+                int j = (i - CaSignals[k].delay + CA_LEN) % CA_LEN;
+                uint64_t chip = (g1_state[i] ^ g2_state[j]) >> 9 & 1;
+                code[k][i/64] |= chip << i%64;
+            }
+    }
+};
+
+constexpr CA_TABLE CaTable;
+
+// Chip i (0 ... CA_LEN-1) of catalogue entry k
+inline int CaChip(int k, int i) {
+    return CaTable.code[k][i>>6] >> (i&63) & 1;
+}
@@ -13,6 +13,8 @@
 #include "gps.h"
 #include "spi.h"
 #include "ephemeris.h"
+#include "nav.h"
+#include "perf.h"
 
 const int PWR_LEN = 8;
 const int MAX_BITS = 64;
@@ -37,10 +39,11 @@ struct CHANNEL { // Locally-held channel data
     int gain_adj;                   // AGC
     int ch, sv;                     // Association
     int probation;                  // Temporarily disables use if channel noisy
-    int holding, rd_pos;            // NAV data bit counters
+    NAV_DECODER nav;                // NAV data bits to subframes
+    int rd_pos;                     // NAV data bit counter
 
     void  Reset();
-    void  Start(int sv, int t_sample, int taps, int lo_shift, int ca_shift);
+    void  Start(int sv, int t_sample, int taps, double lo_shift, double ca_shift);
     void  SetGainAdj(int);
     int   GetGainAdj();
     void  CheckPower();
@@ -50,8 +53,8 @@ struct CHANNEL { // Locally-held channel data
     void  Tracking();
     void  SignalLost();
     void  UploadEmbeddedState();
-    int   ParityCheck(char *buf, int *nbits);
-    void  Subframe(char *buf);
+    int   ParityCheck(int bit);
+    void  Subframe(const uint32_t *sub);
     void  Status();
     int   RemoteBits(uint16_t wr_pos);
     bool  GetSnapshot(uint16_t wr_pos, int *p_sv, int *p_bits, float *p_pwr);
@@ -72,23 +75,6 @@ static double GetFreq(uint16_t *u) { // Convert NCO command to Hertz
 
 ///////////////////////////////////////////////////////////////////////////////////////////////
 
-const char preambleUpright [] = {1,0,0,0,1,0,1,1};
-const char preambleInverse [] = {0,1,1,1,0,1,0,0};
-
-static int parity(char *p, char *word, char D29, char D30) {
-    char *d = word-1;
-    for (int i=1; i<25; i++) d[i] ^= D30;
-    p[0] = D29 ^ d[1] ^ d[2] ^ d[3] ^ d[5] ^ d[6] ^ d[10] ^ d[11] ^ d[12] ^ d[13] ^ d[14] ^ d[17] ^ d[18] ^ d[20] ^ d[23];
-    p[1] = D30 ^ d[2] ^ d[3] ^ d[4] ^ d[6] ^ d[7] ^ d[11] ^ d[12] ^ d[13] ^ d[14] ^ d[15] ^ d[18] ^ d[19] ^ d[21] ^ d[24];
-    p[2] = D29 ^ d[1] ^ d[3] ^ d[4] ^ d[5] ^ d[7] ^ d[8] ^ d[12] ^ d[13] ^ d[14] ^ d[15] ^ d[16] ^ d[19] ^ d[20] ^ d[22];
-    p[3] = D30 ^ d[2] ^ d[4] ^ d[5] ^ d[6] ^ d[8] ^ d[9] ^ d[13] ^ d[14] ^ d[15] ^ d[16] ^ d[17] ^ d[20] ^ d[21] ^ d[23];
-    p[4] = D30 ^ d[1] ^ d[3] ^ d[5] ^ d[6] ^ d[7] ^ d[9] ^ d[10] ^ d[14] ^ d[15] ^ d[16] ^ d[17] ^ d[18] ^ d[21] ^ d[22] ^ d[24];
-    p[5] = D29 ^ d[3] ^ d[5] ^ d[6] ^ d[8] ^ d[9] ^ d[10] ^ d[11] ^ d[13] ^ d[15] ^ d[19] ^ d[22] ^ d[23] ^ d[24];
-    return memcmp(d+25, p, 6);
-}
-
-///////////////////////////////////////////////////////////////////////////////////////////////
-
 void CHANNEL::UploadEmbeddedState() {
     SPI_MISO miso;
     spi_get(CmdGetChan, &miso, sizeof(ul), ch);
@@ -135,8 +121,8 @@ void CHANNEL::Start( // called on search thread to initiate acquisition
     int sv,
     int t_sample,
     int taps,
-    int lo_shift,
-    int ca_shift) {
+    double lo_shift,    // FFT bins, interpolated
+    double ca_shift) {  // samples, interpolated
 
     this->sv = sv;
 
@@ -156,10 +142,10 @@ void CHANNEL::Start( // called on search thread to initiate acquisition
     double secs = (Microseconds()-t_sample) / 1e6;
 
     // Code creep due to code rate Doppler
-    ca_shift += nearbyint(ca_dop*secs*FS/CPS);
+    ca_shift += ca_dop*secs*FS/CPS;
 
     // Align code generator by pausing NCO
-    uint32_t ca_pause = (20000-ca_shift) % 10000;
+    uint32_t ca_pause = (20000-int(nearbyint(ca_shift))) % 10000;
     if (ca_pause) spi_set(CmdPause, ch, ca_pause-1);
 
     spi_set(CmdSetSV, ch, taps); // Gold Code taps
@@ -192,13 +178,26 @@ void CHANNEL::Acquisition() {
     // Code loop always locks, but carrier loop sometimes needs help!
 
     // Carrier might fall outside Costas loop capture range because error in
-    // initial Doppler estimate (FFT bin size) is larger than loop bandwidth.
+    // initial Doppler estimate (interpolated FFT bin) is larger than loop bandwidth.
+
+    const int POLLING=50;           // ms
+    const int TIMEOUT=5000/POLLING; // Code loop settling time
+    const int CONFIRM=4;            // Consecutive polls
+
+    int locked=0;
 
-    // Give them 5 seconds ...
-    TimerWait(5000);
+    for (int n=0; n<TIMEOUT; n++) {
+        TimerWait(POLLING);
+        UploadEmbeddedState();
+
+        // Costas loop already locked on the interpolated Doppler? Energy in I, not Q
+        if (abs(ul.iq[0]) > 4*abs(ul.iq[1])) {
+            if (++locked==CONFIRM) return;
+        }
+        else locked=0;
+    }
 
-    // Get accurate Doppler measurement from locked code NCO
-    UploadEmbeddedState();
+    // Wait for an accurate Doppler measurement from locked code NCO
     double ca_dop = GetFreq(ul.ca_freq) - CPS;
 
     // Put carrier NCO precisely on-frequency.  Now it will lock.
@@ -209,12 +208,10 @@ void CHANNEL::Acquisition() {
 ///////////////////////////////////////////////////////////////////////////////////////////////
 
 void CHANNEL::Tracking() {
-    char buf[300+MAX_BITS-1];
-
     const int POLLING=250;  // Poll 4 times per second
     const int TIMEOUT=80;   // Bail after 20 seconds on LOS
 
-    holding=0;
+    nav.Reset();
 
     for (int watchdog=0; watchdog<TIMEOUT; watchdog++) {
         TimerWait(POLLING);
@@ -223,20 +220,12 @@ void CHANNEL::Tracking() {
         // Process NAV data
         for(int avail = RemoteBits(ul.nav_bits) & ~0xF; avail; avail-=16) {
             int word = ul.nav_buf[rd_pos/16];
-            for (int i=0; i<16; i++) {
-                word<<=1;
-                buf[holding++] = (word>>16) & 1;
-            }
+            for (int i=15; i>=0; i--)
+                if (NAV_OK==ParityCheck(word>>i)) watchdog=0;
             rd_pos+=16;
             rd_pos&=MAX_BITS-1;
         }
 
-        while (holding>=300) { // Enough for a subframe?
-            int nbits;
-            if (0==ParityCheck(buf, &nbits)) watchdog=0;
-            memmove(buf, buf+nbits, holding-=nbits);
-        }
-
         CheckPower();
     }
 }
@@ -294,24 +283,12 @@ float CHANNEL::GetPower() {
 ///////////////////////////////////////////////////////////////////////////////////////////////
 // Debug
 
-static unsigned bin(char *s, int n) {
-    unsigned u=*s;
-    while(--n) u+=u+*++s;
-    return u;
-}
-
-void CHANNEL::Subframe(char *buf) {
-    char *sub = buf+49;
-    char *tow = buf+30;
+void CHANNEL::Subframe(const uint32_t *sub) {
     int id;
 
-    printf("sub %d tow %d  ", id=bin(sub,3), bin(tow,17));
+    printf("sub %d tow %d  ", id = sub[1]>>8 & 7, sub[1]>>13 & 0x1FFFF);
 
-    if (id>3) {
-        int j, pg;
-        for (pg=0, j=0; j<6; j++) pg += pg + buf[62+j];
-        printf("pg %2d", pg);
-    }
+    if (id>3) printf("pg %2d", sub[2]>>22 & 0x3F);
 
     putchar('\n');
 }
@@ -326,30 +303,25 @@ void CHANNEL::Status() {
 
 ///////////////////////////////////////////////////////////////////////////////////////////////
 
-int CHANNEL::ParityCheck(char *buf, int *nbits) {
-    char p[6];
-
-    // Upright or inverted preamble?  Setting of parity bits resolves phase ambiguity.
-    if      (0==memcmp(buf, preambleUpright, 8)) p[4]=p[5]=0;
-    else if (0==memcmp(buf, preambleInverse, 8)) p[4]=p[5]=1;
-    else return *nbits=1;
-
-    // Parity check up to ten 30-bit words ...
-    for (int i=0; i<300; i+=30) {
-        if (parity(p, buf+i, p[4], p[5])) {
-            Status();
-            puts("parity");
-            probation=2;
-            return *nbits=i+30;
-        }
-    }
+int CHANNEL::ParityCheck(int bit) {
+
+    PERF(PERF_PARITY);
+
+    int ret = nav.Push(bit);
+    if (ret==NAV_NONE) return ret;
 
     Status();
-    Subframe(buf);
-    Ephemeris[sv].Subframe(buf);
+    if (ret==NAV_PARITY) {
+        puts("parity");
+        probation=2;
+        return ret;
+    }
+
+    PERF_ITEMS(PERF_PARITY, 1);
+    Subframe(nav.sub);
+    Ephemeris[sv].Subframe(nav.sub);
     if (probation) probation--;
-    *nbits=300;
-    return 0;
+    return ret;
 }
 
 ///////////////////////////////////////////////////////////////////////////////////////////////
@@ -363,7 +335,7 @@ bool CHANNEL::GetSnapshot(
     if (probation) return false; // temporarily too noisy
 
     *p_sv   = sv;
-    *p_bits = holding + RemoteBits(wr_pos);
+    *p_bits = nav.held + RemoteBits(wr_pos);
     *p_pwr  = GetPower();
 
     return true; // ok to use
@@ -410,8 +382,8 @@ void ChanStart( // called on search thread to initiate acquisition of detected S
     int sv,
     int t_sample,
     int taps,
-    int lo_shift,
-    int ca_shift) {
+    double lo_shift,
+    double ca_shift) {
 
     Chans[ch].Start(sv, t_sample, taps, lo_shift, ca_shift);
 }
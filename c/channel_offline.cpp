@@ -0,0 +1,781 @@
+///////////////////////////////////////////////////////////////////////////////////////////////
+// Homemade GPS Receiver
+// Copyright (c) Andrew Holme 2011-2013
+// http://www.holmea.demon.co.uk/GPS/Main.htm
+///////////////////////////////////////////////////////////////////////////////////////////////
+
+#include <inttypes.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <math.h>
+#include <sched.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include "gps_offline.h"
+#include "cacode.h"
+#include "ephemeris.h"
+#include "solution.h"
+#include "nav.h"
+#include "perf.h"
+#include "simd.h"
+
+///////////////////////////////////////////////////////////////////////////////////////////////
+// Software channels for offline captures.  Each does in software what the FPGA correlator
+// and embedded CPU do for channel.cpp: carrier and code NCOs, early/prompt/late correlators,
+// the PI loop filters and NAV bit sync.  The host side (acquisition handoff, AGC, parity,
+// loss of signal) follows channel.cpp, polled by code epochs instead of by the clock.
+// Channels run on tracker threads, fed by the sample bus below.
+
+
+const int LO_PHASES = 64;           // Carrier words start at the nearest 1/64 cycle
+const int LO_SLIP = 1<<18;          // Rate change before the words are rebuilt: 1/256 cycle per word
+const int CODE_Q = 16;              // Code words start at the nearest 1/16 sample
+
+const double FPGA_FS = 10e6;        // Loop gains are for FPGA correlator sums at this rate
+const double LO_AMP = 1200;         // ... and the Costas gains for this prompt amplitude (FPGA AGC low)
+
+#define CA_END (uint64_t(CA_LEN)<<32)
+
+struct SLOT;
+
+struct CHANNEL {
+    // Correlator
+    uint32_t lo_phase, lo_rate;     // Carrier NCO, cycles * 2^32
+    uint64_t ca_phase;              // Code NCO, chips * 2^32 into the code period
+    uint32_t ca_rate;               // chips * 2^32 per sample
+    int      acc[6];                // IE, QE, IP, QP, IL, QL over this code period
+    uint64_t lo_tab[LO_PHASES][2];  // Carrier I, Q sign words from each starting phase ...
+    uint32_t lo_tab_rate;           // ... at this rate
+
+    // Embedded CPU state
+    uint64_t lo_freq, ca_freq;      // Loop filter integrators, FS * 2^-64
+    int      lo_gain[2], ca_gain[2];// ki, kp
+    float    iq[2];                 // Last I, Q, scaled to FPGA_FS
+    int      epochs;                // Code periods since Start()
+    int      nav_ms;                // Milliseconds into bit 0 ... 19
+    int      nav_sum, nav_prev;     // Prompt I summed over bit; sign of last epoch
+    int      nav_hist[20], nav_flips; // Bit sync: transitions at each ms of the bit
+    bool     nav_sync;
+
+    // Host side, as channel.cpp
+    NAV_DECODER nav;                // NAV data bits to subframes
+    double lock_sum[3];             // Prompt |IQ|^2, |IQ|^4, I^2-Q^2 summed over LOCK_MS ...
+    double lock_avg[3];             // ... and smoothed per update
+    int   lock_ms, lock_n;          // Epochs summed; updates since tracking began
+    int   lock_fails;               // Consecutive updates below CN0_MIN or PLI_MIN
+    float cn0, pli;                 // dB-Hz; cos(2 x carrier phase error)
+    int   ch, sv;                   // Association: CaSignals[sv], Ephemeris[sv]
+    int   probation;                // Temporarily disables use if channel noisy
+    bool  busy, acquiring;
+    int   poll, watchdog;           // Epochs to next poll; polls without a subframe
+    int   locked;                   // Polls with Costas lock during acquisition
+
+    void  Reset();
+    void  Start(int sv, double lo_shift, double ca_shift);
+    float GetPower();
+    void  LockDetect();
+    void  LoTable();
+    void  Replica(uint64_t *rep, int a, int b);
+    void  Accumulate(const SLOT *s, uint64_t *rep, int a, int b);
+    void  Correlate(const SLOT *s, uint64_t *rep);
+    void  Epoch();
+    void  LoopFilters();
+    void  BitSync(int ip);
+    void  Service();
+    void  Acquisition();
+    void  Tracking();
+    void  SignalLost();
+    int   ParityCheck(int bit);
+    void  Subframe(const uint32_t *sub);
+    void  Status();
+    bool  GetSnapshot(SNAPSHOT *rep);
+};
+
+// Channel pool, sized by ChanInit().  A set bit in FreeChans is a free channel: the receive
+// thread takes them, trackers give them back on loss of signal.
+static CHANNEL  *Chans;
+static int       NumChans;
+static uint64_t *FreeChans;
+static int       ChansLost;         // Set by SignalLost(), taken by ChanLost()
+
+// Code replicas sampled at FS, 1 = negative chip, one row per 1/CODE_Q sample of code phase.
+// Row bit i is the chip at sample i-code_m from chip 0, so words can start before chip 0
+// (late, and the part of a word before an epoch) or run on past the end of the code.
+static uint64_t *Codes[CA_PRNS];
+static int       code_words;        // Per row
+static int       code_m;            // Margin, samples
+static double    spc;               // Samples per chip
+
+///////////////////////////////////////////////////////////////////////////////////////////////
+// Sample bus.  The receive thread unpacks each block once into a ring of slots, and tracker
+// threads, each owning every NumTrackers'th channel, correlate straight from the slots.
+// Lock-free: the producer publishes bus_head, each tracker its own tail, and a slot is only
+// reused once the slowest tail has passed it.
+
+const int BUS_SLOTS = 128;          // Blocks, ~128 ms
+const int LAG_WARN = 20;            // ms a tracker may trail the leader before it is reported
+
+struct SLOT {
+    uint64_t  t;                    // Timestamp: capture sample of bit 0
+    int       n;                    // Samples
+    uint64_t *bits[2];              // Sign bits, 1 = negative, LSB first: I, then Q for IQ formats
+};
+
+struct TRACKER {
+    pthread_t thread;
+    int       id;
+    uint64_t  tail;                 // Blocks done
+    uint64_t  t;                    // Timestamp of the end of the last block done
+    uint64_t *rep;                  // Replica words for one channel: see BitCorr()
+    int64_t   lag;                  // Most samples behind the leading tracker since last report
+    char      pad[64];              // Keep tails off each other's cache lines
+
+    void Track(const SLOT *s);
+};
+
+static SLOT     Bus[BUS_SLOTS];
+static uint64_t bus_head;           // Blocks published
+static uint64_t bus_t;              // Samples published
+static int      bus_words;          // Per slot row
+static bool     bus_quit;
+static TRACKER *Trackers;
+static int      NumTrackers;
+static bool     Complex;
+
+///////////////////////////////////////////////////////////////////////////////////////////////
+
+static uint64_t SetFreq(double hz) { // Hertz to NCO command
+    double f = hz/FS;
+    return uint64_t(ldexp(f-floor(f), 64));
+}
+
+static double GetFreq(uint64_t u, double nominal) { // NCO command to Hertz from nominal
+    return ldexp(double(int64_t(u - SetFreq(nominal))), -64) * FS;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////
+
+static void CodeTable(int sv) {
+    if (!code_words) {
+        spc = FS/CPS;
+        code_m = 64 + int(ceil(spc));
+        code_words = (2*code_m + int(ceil(CA_LEN*spc)) + 64)/64 + 1;
+    }
+
+    uint64_t *t = Codes[sv] = (uint64_t *) calloc(CODE_Q*code_words, sizeof(uint64_t));
+    for (int q=0; q<CODE_Q; q++, t+=code_words)
+        for (int i=0; i<code_words*64; i++) {
+            int chip = int(floor((i - code_m + double(q)/CODE_Q) / spc));
+            t[i/64] |= uint64_t(CaChip(sv, (chip%CA_LEN + CA_LEN)%CA_LEN)) << i%64;
+        }
+}
+
+static inline uint64_t CodeWord(const uint64_t *t, double pos) { // pos: samples into table
+    int64_t u = int64_t(pos*CODE_Q + 0.5);
+    int i = int(u/CODE_Q), sh = i%64;
+    t += int(u%CODE_Q)*code_words + i/64;
+    return sh? t[0]>>sh | t[1]<<(64-sh) : t[0];
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////
+
+void CHANNEL::Reset() {
+    lo_gain[0] = 20;
+    lo_gain[1] = 27;
+    ca_gain[0] = 20-9;
+    ca_gain[1] = 27-4;
+
+    memset(lock_sum, 0, sizeof lock_sum);
+    memset(lock_avg, 0, sizeof lock_avg);
+    lock_ms = lock_n = lock_fails = 0;
+    cn0 = pli = 0;
+    probation=2;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////
+
+void CHANNEL::Start( // called on search thread to initiate acquisition
+    int sv,
+    double lo_shift,    // FFT bins, interpolated
+    double ca_shift) {  // samples, interpolated
+
+    this->sv = sv;
+
+    if (!Codes[sv]) CodeTable(sv);
+
+    // Estimate Doppler from FFT bin shift
+    double lo_dop = lo_shift*FS/FFT_LEN;
+    double ca_dop = lo_dop/L1*CPS;
+
+    // Initialise code and carrier NCOs
+    lo_freq = SetFreq(FC  + lo_dop);
+    ca_freq = SetFreq(CPS + ca_dop);
+    lo_rate = lo_freq>>32;
+    ca_rate = ca_freq>>32;
+    lo_phase = 0;
+    LoTable();
+
+    // Code phase at the first sample of the next block, which the search also started at
+    double chips = fmod(ca_shift*CPS/FS, CA_LEN);
+    ca_phase = uint64_t(ldexp(chips, 32)) % CA_END;
+
+    memset(acc, 0, sizeof acc);
+    memset(nav_hist, 0, sizeof nav_hist);
+    epochs = nav_ms = nav_sum = nav_prev = nav_flips = 0;
+    nav_sync = false;
+
+    nav.Reset();
+    watchdog = locked = 0;
+    acquiring = true;
+    poll = 50;
+    busy = true;
+
+    printf("chan %d PRN %2d enter\n", ch, CaSignals[sv].prn);
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////
+// Correlators: the FPGA's quadrature square-wave LO, 1-bit samples, E/P/L summed over a code
+// period.  Samples and replicas are bit-packed, so each product is an XOR and each sum a
+// popcount, 64 samples at a time.  The loop filters run at each period's end, as the
+// embedded CPU does.
+
+void CHANNEL::LoTable() {
+    for (int p=0; p<LO_PHASES; p++) {
+        uint64_t c=0, s=0;
+        uint32_t phase = uint32_t(p)<<26;
+        for (int i=0; i<64; i++, phase+=lo_rate) {
+            int quad = phase>>30;
+            c |= uint64_t(quad==1 || quad==2) << i; // cos < 0
+            s |= uint64_t(quad<2) << i;             // -sin < 0
+        }
+        lo_tab[p][0] = c;
+        lo_tab[p][1] = s;
+    }
+    lo_tab_rate = lo_rate;
+}
+
+// Replica words for samples a ... b-1 of the block; bits outside are zero
+void CHANNEL::Replica(uint64_t *rep, int a, int b) {
+    const uint64_t *t = Codes[sv];
+    const double half = spc/2;
+    int w0 = a/64, n = (b+63)/64 - w0;
+
+    if (abs(int32_t(lo_rate-lo_tab_rate)) > LO_SLIP) LoTable();
+
+    for (int w=0; w<n; w++) {
+        int k = 64*(w0+w) - a; // NCOs run back from sample a to the start of the word
+
+        const uint64_t *lo = lo_tab[(lo_phase + uint32_t(k)*lo_rate + (1<<25)) >> 26];
+        rep[0*n+w] = lo[0];
+        rep[1*n+w] = lo[1];
+
+        double pos = ldexp(double(int64_t(ca_phase) + int64_t(k)*ca_rate), -32)*spc + code_m;
+        rep[2*n+w] = CodeWord(t, pos + half);
+        rep[3*n+w] = CodeWord(t, pos);
+        rep[4*n+w] = CodeWord(t, pos - half);
+    }
+
+    uint64_t m0 = ~0ULL << a%64, m1 = ~0ULL >> (63-(b-1)%64);
+    for (int r=0; r<5; r++) {
+        rep[r*n] &= m0;
+        rep[r*n+n-1] &= m1;
+    }
+}
+
+void CHANNEL::Accumulate(const SLOT *s, uint64_t *rep, int a, int b) { // samples a ... b-1, all in this code period
+    int w0 = a/64, n = (b+63)/64 - w0, len = b-a;
+    int pi[6], pq[6];
+
+    Replica(rep, a, b);
+
+    // Zero replica bits leave the sample bits: take those out of every count
+    uint64_t m0 = ~0ULL << a%64, m1 = ~0ULL >> (63-(b-1)%64);
+    const uint64_t *x = s->bits[0]+w0;
+    int out = n>1? __builtin_popcountll(x[0] & ~m0) + __builtin_popcountll(x[n-1] & ~m1)
+                 : __builtin_popcountll(x[0] & ~(m0&m1));
+    BitCorr(pi, x, rep, n);
+
+    if (Complex) { // (I + jQ)(cos - j sin): I*cos - Q*(-sin), Q*cos + I*(-sin)
+        const uint64_t *y = s->bits[1]+w0;
+        int outq = n>1? __builtin_popcountll(y[0] & ~m0) + __builtin_popcountll(y[n-1] & ~m1)
+                      : __builtin_popcountll(y[0] & ~(m0&m1));
+        BitCorr(pq, y, rep, n);
+        for (int j=0; j<6; j+=2) {
+            acc[j+0] += 2*((pq[j+1]-outq) - (pi[j+0]-out));
+            acc[j+1] += 2*len - 2*((pq[j+0]-outq) + (pi[j+1]-out));
+        }
+    }
+    else
+        for (int j=0; j<6; j++) acc[j] += len - 2*(pi[j]-out);
+
+    lo_phase += uint32_t(len)*lo_rate;
+    ca_phase += uint64_t(len)*ca_rate;
+}
+
+void CHANNEL::Correlate(const SLOT *s, uint64_t *rep) { // whole block
+    for (int a=0, n=s->n; a<n; ) {
+        // Samples to the end of this code period
+        int m = int(MIN(uint64_t(n-a), (CA_END-ca_phase+ca_rate-1)/ca_rate));
+
+        Accumulate(s, rep, a, a+m);
+        a += m;
+
+        if (ca_phase>=CA_END) {
+            ca_phase -= CA_END;
+            Epoch();
+            if (!busy) return;
+        }
+    }
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////
+
+void CHANNEL::Epoch() { // end of a code period
+    const float scale = FPGA_FS/FS;
+
+    iq[0] = acc[2]*scale;
+    iq[1] = acc[3]*scale;
+
+    // Wait 3 epochs to be sure phase errors are valid before enabling PI controllers
+    if (++epochs>3) LoopFilters();
+    BitSync(acc[2]);
+
+    memset(acc, 0, sizeof acc);
+    if (--poll==0) Service();
+    if (busy && !acquiring) LockDetect();
+}
+
+void CHANNEL::LoopFilters() {
+    const double scale = FPGA_FS/FS;
+
+    // Costas: I*Q over prompt power, so its gain does not follow signal strength as on the
+    // FPGA, which needs the AGC.  Code: early minus late power.  Both in FPGA units.
+    double p = double(iq[0])*iq[0] + double(iq[1])*iq[1];
+    double lo_err = p>0? iq[0]*iq[1]/p * LO_AMP*LO_AMP : 0;
+    double ca_err = (double(acc[0])*acc[0] + double(acc[1])*acc[1]
+                   - double(acc[4])*acc[4] - double(acc[5])*acc[5]) * scale*scale;
+
+    // Integrator += err << ki; rate = integrator + (err << kp).  FS * 2^-64 units,
+    // rescaled so the gains in Hz are those of the FPGA at FPGA_FS.
+    lo_freq += int64_t(ldexp(lo_err, lo_gain[0]) * scale);
+    ca_freq += int64_t(ldexp(ca_err, ca_gain[0]) * scale);
+
+    lo_rate = (lo_freq + int64_t(ldexp(lo_err, lo_gain[1]) * scale)) >> 32;
+    ca_rate = (ca_freq + int64_t(ldexp(ca_err, ca_gain[1]) * scale)) >> 32;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////
+// NAV bits: find which millisecond the data transitions fall on, then sum prompt I over
+// each 20 ms bit.
+
+const int SYNC_FLIPS = 32;          // Transitions seen before choosing the bit edge
+
+void CHANNEL::BitSync(int ip) {
+    int sign = ip<0;
+    bool flip = sign!=nav_prev;
+    nav_prev = sign;
+
+    if (!nav_sync) {
+        // Costas loop still pulling in flips at random: count once acquired
+        if (acquiring) return;
+        if (flip) nav_hist[epochs%20]++, nav_flips++;
+        if (nav_flips<SYNC_FLIPS) return;
+
+        int edge=0;
+        for (int i=1; i<20; i++) if (nav_hist[i]>nav_hist[edge]) edge=i;
+
+        // This epoch is nav_ms into the bit starting at the last edge; first bit is partial
+        nav_ms = (epochs-edge+20)%20;
+        nav_sum = 0;
+        nav_sync = true;
+    }
+
+    if (nav_ms==0) nav_sum = 0;
+    nav_sum += ip;
+
+    if (++nav_ms==20) {
+        nav_ms = 0;
+        if (NAV_OK==ParityCheck(nav_sum<0)) watchdog=0;
+    }
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////
+
+void CHANNEL::Service() { // called every poll epochs, as the channel thread would wake
+
+    if (acquiring) Acquisition();
+    else Tracking();
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////
+
+void CHANNEL::Acquisition() {
+
+    // Carrier might fall outside Costas loop capture range because error in
+    // initial Doppler estimate (interpolated FFT bin) is larger than loop bandwidth.
+
+    const int POLLING=50;           // ms
+    const int TIMEOUT=5000/POLLING; // Code loop settling time
+    const int CONFIRM=4;            // Consecutive polls
+
+    poll = POLLING;
+
+    // Costas loop already locked on the interpolated Doppler? Energy in I, not Q
+    if (fabs(iq[0]) > 4*fabs(iq[1])) {
+        if (++locked==CONFIRM) {
+            acquiring = false;
+            poll = 250;
+            return;
+        }
+    }
+    else locked=0;
+
+    // Wait for an accurate Doppler measurement from locked code NCO
+    if (epochs<TIMEOUT*POLLING) return;
+    double ca_dop = GetFreq(ca_freq, CPS);
+
+    // Put carrier NCO precisely on-frequency.  Now it will lock.
+    lo_freq = SetFreq(FC + ca_dop*L1/CPS);
+    lo_rate = lo_freq>>32;
+    acquiring = false;
+    poll = 250;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////
+
+void CHANNEL::Tracking() {
+    const int POLLING=250;  // Poll 4 times per second
+    const int TIMEOUT=80;   // Bail after 20 seconds locked without a subframe
+
+    poll = POLLING;
+
+    if (++watchdog==TIMEOUT) SignalLost();
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////
+
+void CHANNEL::SignalLost() {
+    busy = false;
+    __atomic_fetch_or(FreeChans+ch/64, 1ULL<<ch%64, __ATOMIC_RELEASE);
+
+    // Re-enable search for this SV, and have the receive thread search for it now
+    SearchEnable(sv);
+    __atomic_store_n(&ChansLost, 1, __ATOMIC_RELEASE);
+
+    printf("chan %d PRN %2d leave\n", ch, CaSignals[sv].prn);
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////
+
+float CHANNEL::GetPower() { // prompt signal power, noise removed
+    return sqrt(MAX(0.0, 2*lock_avg[0]*lock_avg[0] - lock_avg[1]));
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////
+// Lock detectors, from the prompt sums of every code period once tracking.
+// C/N0 by the moment method: with P = I^2+Q^2, signal power is sqrt(2 E[P]^2 - E[P^2])
+// and the rest of E[P] is noise, whatever the data bits.  Costas lock by the narrowband
+// phase detector: E[I^2-Q^2] / E[I^2+Q^2] = cos(2 x phase error), less at low C/N0.
+
+const int LOCK_MS = 20;             // Epochs per update
+const double LOCK_K = 0.25;         // Smoothing per update: ~80 ms
+const int LOCK_SETTLE = 10;         // Updates after acquisition before judging lock
+const int LOCK_FAILS = 5;           // Consecutive failed updates to lose the channel: 100 ms
+const float CN0_MIN = 30;           // dB-Hz, after 1-bit sampling
+const float PLI_MIN = 0.2;          // Phase error within about 40 degrees: loops jitter 30 on strong signals
+
+void CHANNEL::LockDetect() {
+    double i2 = double(iq[0])*iq[0], q2 = double(iq[1])*iq[1];
+
+    lock_sum[0] += i2+q2;
+    lock_sum[1] += (i2+q2)*(i2+q2);
+    lock_sum[2] += i2-q2;
+    if (++lock_ms<LOCK_MS) return;
+
+    for (int j=0; j<3; j++) {
+        double m = lock_sum[j]/LOCK_MS;
+        lock_avg[j] = lock_n? lock_avg[j] + LOCK_K*(m-lock_avg[j]) : m;
+        lock_sum[j] = 0;
+    }
+    lock_ms = 0;
+
+    double sig = GetPower(), noise = lock_avg[0]-sig;
+    cn0 = sig>0 && noise>0? 10*log10(sig/noise*1000) : sig>0? 99 : 0; // 1 ms periods
+    pli = lock_avg[0]>0? lock_avg[2]/lock_avg[0] : 0;
+
+    if (++lock_n<=LOCK_SETTLE) return;
+
+    if (cn0>=CN0_MIN && pli>=PLI_MIN) lock_fails=0;
+    else if (++lock_fails==LOCK_FAILS) {
+        printf("chan %d PRN %2d cn0 %4.1f pli %5.2f lost lock\n", ch, CaSignals[sv].prn, cn0, pli);
+        SignalLost();
+    }
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////
+// Debug
+
+void CHANNEL::Subframe(const uint32_t *sub) {
+    int id;
+
+    printf("sub %d tow %d  ", id = sub[1]>>8 & 7, sub[1]>>13 & 0x1FFFF);
+
+    if (id>3) printf("pg %2d", sub[2]>>22 & 0x3F);
+
+    putchar('\n');
+}
+
+void CHANNEL::Status() {
+    double rssi = sqrt(GetPower());
+    double lo_f = GetFreq(lo_freq, FC);
+    double ca_f = GetFreq(ca_freq, CPS);
+
+    printf("chan %d PRN %2d rssi %4.0f cn0 %4.1f pli %5.2f freq %5.0f %6.3f ",
+        ch, CaSignals[sv].prn, rssi, cn0, pli, lo_f, ca_f);
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////
+
+int CHANNEL::ParityCheck(int bit) { // each NAV bit, as it is summed
+
+    PERF(PERF_PARITY);
+
+    int ret = nav.Push(bit);
+    if (ret==NAV_NONE) return ret;
+
+    flockfile(stdout); // one line among the other trackers'
+    Status();
+    if (ret==NAV_PARITY) {
+        puts("parity");
+        funlockfile(stdout);
+        probation=2;
+        return ret;
+    }
+    Subframe(nav.sub);
+    funlockfile(stdout);
+
+    PERF_ITEMS(PERF_PARITY, 1);
+    Ephemeris[sv].Subframe(nav.sub);
+    if (probation) probation--;
+    return ret;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////
+
+bool CHANNEL::GetSnapshot(SNAPSHOT *rep) {
+
+    if (probation || lock_fails || !Ephemeris[sv].Valid()) return false; // temporarily too noisy
+
+    int chips = ca_phase>>32;
+
+    rep->ch       = ch;
+    rep->sv       = sv;
+    rep->power    = GetPower();
+    rep->bits     = nav.held;                   // NAV bits since the last subframe edge
+    rep->ms       = nav_ms;                     // Milliseconds since last bit
+    rep->g1       = CaTable.g1_state[chips];    // Code chips, as the FPGA's G1 register
+    rep->ca_phase = (ca_phase>>26) & 63;        // Code NCO phase, 1/64 chips
+    memcpy(&rep->eph, Ephemeris+sv, sizeof rep->eph);
+
+    return true; // ok to use
+}
+
+bool ChanSnapshot(int ch, SNAPSHOT *rep) { // called on solver thread, trackers synced
+    return Chans[ch].busy && !Chans[ch].acquiring && Chans[ch].GetSnapshot(rep);
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////
+
+static void Backoff(int &spins) { // other end of the bus is behind: give it the core
+    if (++spins<64) sched_yield();
+    else usleep(100);
+}
+
+static uint64_t SlowestTail() {
+    uint64_t min = bus_head;
+    for (int k=0; k<NumTrackers; k++) min = MIN(min, __atomic_load_n(&Trackers[k].tail, __ATOMIC_ACQUIRE));
+    return min;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////
+
+void TRACKER::Track(const SLOT *s) {
+    int busy=0;
+
+    // How far behind the leader?
+    uint64_t lead=t;
+    for (int k=0; k<NumTrackers; k++) lead = MAX(lead, __atomic_load_n(&Trackers[k].t, __ATOMIC_RELAXED));
+    lag = MAX(lag, int64_t(lead - s->t));
+
+    PERF(PERF_TRACK);
+    for (int ch=id; ch<NumChans; ch+=NumTrackers)
+        if (Chans[ch].busy) Chans[ch].Correlate(s, rep), busy++;
+    PERF_ITEMS(PERF_TRACK, int64_t(s->n)*busy);
+    __atomic_store_n(&t, s->t + s->n, __ATOMIC_RELAXED);
+}
+
+static void *TrackerThread(void *param) {
+    TRACKER *k = (TRACKER *) param;
+
+    for (int spins=0;;) {
+        if (k->tail == __atomic_load_n(&bus_head, __ATOMIC_ACQUIRE)) {
+            if (__atomic_load_n(&bus_quit, __ATOMIC_ACQUIRE)) return NULL;
+            Backoff(spins);
+            continue;
+        }
+        spins=0;
+        k->Track(Bus + k->tail%BUS_SLOTS);
+        __atomic_store_n(&k->tail, k->tail+1, __ATOMIC_RELEASE);
+    }
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////
+
+int ChanInit(int n) { // n: most samples per block
+    if (channels<1) channels = NUM_CHANS;
+    NumChans = channels;
+    NumTrackers = trackers>0? trackers : sysconf(_SC_NPROCESSORS_ONLN);
+    NumTrackers = MAX(1, MIN(NumTrackers, NumChans));
+
+    Chans = (CHANNEL *) calloc(NumChans, sizeof(CHANNEL));
+    FreeChans = (uint64_t *) calloc((NumChans+63)/64, sizeof(uint64_t));
+    if (!Chans || !FreeChans) return -1;
+    for (int ch=0; ch<NumChans; ch++) {
+        Chans[ch].ch = ch;
+        FreeChans[ch/64] |= 1ULL<<ch%64;
+    }
+
+    Complex = format>FMT_2BIT;
+    bus_words = (n+63)/64;
+    bus_head = bus_t = 0;
+    bus_quit = false;
+
+    for (int i=0; i<BUS_SLOTS; i++)
+        for (int k=0; k<2; k++)
+            if (!(Bus[i].bits[k] = (uint64_t *) calloc(bus_words, sizeof(uint64_t)))) return -1;
+
+    Trackers = (TRACKER *) calloc(NumTrackers, sizeof(TRACKER));
+    if (!Trackers) return -1;
+
+    for (int k=0; k<NumTrackers; k++) {
+        TRACKER *w = Trackers+k;
+        w->id = k;
+        if (!(w->rep = (uint64_t *) malloc(5*bus_words*sizeof(uint64_t)))) return -2;
+        if (pthread_create(&w->thread, NULL, TrackerThread, w)) return -3;
+    }
+
+    return NumTrackers;
+}
+
+void ChanFree() {
+    ChanSync();
+    __atomic_store_n(&bus_quit, true, __ATOMIC_RELEASE);
+
+    for (int k=0; k<NumTrackers; k++) {
+        pthread_join(Trackers[k].thread, NULL);
+        free(Trackers[k].rep);
+    }
+    for (int i=0; i<BUS_SLOTS; i++)
+        for (int k=0; k<2; k++) free(Bus[i].bits[k]);
+
+    free(Trackers);
+    free(Chans);
+    free(FreeChans);
+    Trackers = NULL;
+    Chans = NULL;
+    FreeChans = NULL;
+    NumTrackers = NumChans = 0;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////
+
+void ChanSync() { // wait for every tracker to finish the blocks published; report laggards
+    for (int spins=0; SlowestTail()!=bus_head; ) Backoff(spins);
+
+    for (int k=0; k<NumTrackers; k++) {
+        TRACKER *w = Trackers+k;
+        if (w->lag*1000 > LAG_WARN*FS) {
+            flockfile(stdout);
+            printf("tracker %d lagging %.0f ms: chans", k, w->lag*1000/FS);
+            for (int ch=k; ch<NumChans; ch+=NumTrackers)
+                if (Chans[ch].busy) printf(" %d", ch);
+            putchar('\n');
+            funlockfile(stdout);
+        }
+        w->lag = 0;
+    }
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////
+
+void ChanSamples(const unsigned char *rx, int n) { // publish one block of capture to the trackers
+    int k;
+
+    // Slot free once the slowest tracker is done with it
+    for (int spins=0; bus_head-SlowestTail() >= BUS_SLOTS; ) Backoff(spins);
+
+    SLOT *s = Bus + bus_head%BUS_SLOTS;
+    uint64_t **Block = s->bits;
+
+    // Sign bits, as the FPGA's 1-bit input; a 1-bit capture already is
+    {
+        PERF(PERF_UNPACK);
+        if (format==FMT_1BIT) {
+            Block[0][(n-1)/64] = 0;
+            memcpy(Block[0], rx, (n+7)/8);
+        }
+        else {
+            memset(Block[0], 0, bus_words*sizeof(uint64_t));
+            memset(Block[1], 0, bus_words*sizeof(uint64_t));
+            for (k=0; k<n; k++) {
+                int i, q=0;
+                switch (format) {
+                    case FMT_2BIT:   i = rx[k/4]>>(2*(k%4)) & 1; break;
+                    case FMT_RTL:    i = rx[2*k]<128;   q = rx[2*k+1]<128;   break;
+                    case FMT_HACKRF: i = rx[2*k]>>7;    q = rx[2*k+1]>>7;    break;
+                    default:         i = rx[4*k+1]>>7;  q = rx[4*k+3]>>7;    break; // FMT_INT16
+                }
+                Block[0][k/64] |= uint64_t(i) << k%64;
+                Block[1][k/64] |= uint64_t(q) << k%64;
+            }
+        }
+    }
+    PERF_ITEMS(PERF_UNPACK, n);
+
+    s->t = bus_t;
+    s->n = n;
+    bus_t += n;
+    __atomic_store_n(&bus_head, bus_head+1, __ATOMIC_RELEASE);
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////
+
+int ChanReset() { // called on search thread before sampling, trackers synced
+    for (int w=0; w<(NumChans+63)/64; w++) {
+        uint64_t free = __atomic_load_n(FreeChans+w, __ATOMIC_ACQUIRE);
+        if (!free) continue;
+        int ch = w*64 + __builtin_ctzll(free);
+        Chans[ch].Reset();
+        return ch;
+    }
+
+    return -1; // all channels busy
+}
+
+bool ChanLost() { // any channel lost its signal since the last call
+    return __atomic_exchange_n(&ChansLost, 0, __ATOMIC_ACQ_REL);
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////
+
+void ChanStart( // called on search thread to initiate acquisition of detected SV
+    int ch,
+    int sv,
+    double lo_shift,
+    double ca_shift) {
+
+    __atomic_fetch_and(FreeChans+ch/64, ~(1ULL<<ch%64), __ATOMIC_RELAXED);
+    Chans[ch].Start(sv, lo_shift, ca_shift);
+}
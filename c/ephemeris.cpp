@@ -180,19 +180,16 @@ bool EPHEM::Valid() {
 
 ///////////////////////////////////////////////////////////////////////////////////////////////
 
-void EPHEM::Subframe(char *buf) { // called from channel tasks
+void EPHEM::Subframe(const unsigned *sub) { // called from channel tasks
     char nav[30];
 
-    int id=buf[49];
-    id+=id+buf[50];
-    id+=id+buf[51];
+    int id = sub[1]>>8 & 7; // HOW D20 ... D22
 
-    for (int i=0; i<30; buf+=6) {
-        for (int j=0; j<3; j++) {
-            int byte=0;
-            for (int k=0; k<8; k++) byte += byte + *buf++;
-            nav[i++] = byte;
-        }
+    // D1 ... D24 of each word, already packed: three bytes apiece
+    for (int i=0; i<30; sub++) {
+        nav[i++] = *sub>>22;
+        nav[i++] = *sub>>14;
+        nav[i++] = *sub>>6;
     }
 
     tow = PACK(nav[3], nav[4], nav[5]).u(17);
@@ -205,3 +202,37 @@ void EPHEM::Subframe(char *buf) { // called from channel tasks
 //      case 5: Subframe5(nav); break;
     }
 }
+
+///////////////////////////////////////////////////////////////////////////////////////////////
+
+// From a RINEX navigation record: t_oc in seconds of week; orbit[] = SV clock bias,
+// drift, drift rate, then broadcast orbits 1 ... 6 in file order.  Angles are in radians.
+void EPHEM::Rinex(double toc, const double *orbit) {
+    const double *v = orbit;
+
+    t_oc      = unsigned(toc);
+    a_f[0]    = v[ 0];
+    a_f[1]    = v[ 1];
+    a_f[2]    = v[ 2];
+    IODE2     = unsigned(v[ 3]);
+    C_rs      = v[ 4];
+    dn        = v[ 5];
+    M_0       = v[ 6];
+    C_uc      = v[ 7];
+    e         = v[ 8];
+    C_us      = v[ 9];
+    sqrtA     = v[10];
+    t_oe      = unsigned(v[11]);
+    C_ic      = v[12];
+    OMEGA_0   = v[13];
+    C_is      = v[14];
+    i_0       = v[15];
+    C_rc      = v[16];
+    omega     = v[17];
+    OMEGA_dot = v[18];
+    IDOT      = v[19];
+    week      = unsigned(v[21]);
+    t_gd      = v[25];
+    IODC      = unsigned(v[26]);
+    IODE3     = IODE2;
+}
@@ -33,7 +33,8 @@ class EPHEM {
 public:
     unsigned tow;
 
-    void   Subframe(char *buf);
+    void   Subframe(const unsigned *sub); // ten words from NAV_DECODER
+    void   Rinex(double t_oc, const double *orbit);
     bool   Valid();
     double GetClockCorrection(double t);
     void   GetXYZ(double *x, double *y, double *z, double t);
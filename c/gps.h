@@ -90,7 +90,7 @@ int  SearchCode(int sv, int g1);
 
 void ChanTask(void);
 int  ChanReset(void);
-void ChanStart(int ch, int sv, int t_sample, int taps, int lo_shift, int ca_shift);
+void ChanStart(int ch, int sv, int t_sample, int taps, double lo_shift, double ca_shift);
 bool ChanSnapshot(int ch, uint16_t wpos, int *p_sv, int *p_bits, float *p_pwr);
 
 //////////////////////////////////////////////////////////////
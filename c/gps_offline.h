@@ -13,8 +13,8 @@
 // Parameters
 
 #define FFT_LEN  40000
-#define NUM_SATS    32
-#define NUM_CHANS   12
+#define NUM_SATS    32 // GPS ephemerides; the search takes its PRNs from the catalogue in cacode.h
+#define NUM_CHANS   12 // software channels unless set by channels
 
 ///////////////////////////////////////////////////////////////////////////////
 // Frequencies
@@ -23,6 +23,34 @@
 extern double FC;
 extern double FS;
 extern double max_fo;
+extern int snapshot; // search all SVs in one sample capture
+extern int threads;  // acquisition worker threads, 0 = one per core
+extern int trackers; // software channel threads, 0 = one per core
+extern int channels; // software channel pool, 0 = NUM_CHANS
+extern int batch;    // Doppler bins per batched inverse FFT
+extern int noncoh;   // FFT_LEN blocks summed non-coherently per search
+extern int coarse;   // two-stage search: decimated full range, then full rate at peak
+enum FORMAT {
+    FMT_1BIT,   // packed 1-bit real IF (default)
+    FMT_2BIT,   // packed 2-bit sign/magnitude real IF
+    FMT_RTL,    // rtl-sdr uint8 IQ
+    FMT_HACKRF, // HackRF int8 IQ
+    FMT_INT16   // int16 IQ
+};
+
+extern FORMAT format; // of the capture file
+extern double start_time; // seconds into capture to start searching
+extern double duration;   // seconds to search, 0 = to end of capture
+extern char *cache_dir;   // code spectra cache and FFTW wisdom, NULL = none
+extern unsigned planner;  // FFTW planner flags
+extern char *prns;        // PRNs to search, e.g. "1-32,120-158"; NULL = GPS 1-32
+extern char *aid_file;    // RINEX navigation file for assisted search, NULL = unaided
+extern char *aid_time;    // GPS time at start of capture, NULL = now
+extern double aid_lat, aid_lon, aid_alt; // approximate position, degrees and metres
+extern double aid_window; // Doppler search either side of prediction or warm start, Hz
+extern double aid_mask;   // elevation mask, degrees
+extern char *warm_file;   // last acquisition per PRN, read at start and rewritten each sweep; NULL = none
+                          // times are of capture: aid_time if a date, else file mtime less length, else now
 //#define FC 2.6e6     // Carrier @ 2nd IF
 //#define FC 4.092e6     // Carrier @ 2nd IF
 //#define FS 10e6      // Sampling rate
@@ -87,21 +115,30 @@ void peri_spi(SPI_SEL sel, char *mosi, int txlen, char *miso, int rxlen);
 int  SearchInit();
 void SearchFree();
 void SearchTask(char *filename_1bit_bin);
+void ReceiveTask(char *filename);   // search, track and solve along the capture
 void SearchEnable(int sv);
 int  SearchCode(int sv, int g1);
 
 //////////////////////////////////////////////////////////////
-// Tracking
+// Tracking: software channels on tracker threads, fed the capture a block at a time.
+// Reset, Start and Snapshot only between ChanSync() and the next ChanSamples().
+
+struct SNAPSHOT;
 
-void ChanTask(void);
-int  ChanReset(void);
-void ChanStart(int ch, int sv, int t_sample, int taps, int lo_shift, int ca_shift);
-bool ChanSnapshot(int ch, uint16_t wpos, int *p_sv, int *p_bits, float *p_pwr);
+int  ChanInit(int n);                                               // n samples per block max; trackers, <0 = error
+                                                                    // channels 0 ... channels-1
+void ChanFree(void);
+void ChanSync(void);                                                // wait for trackers to catch up
+int  ChanReset(void);                                               // free channel, -1 = all busy
+bool ChanLost(void);                                                // a channel freed itself since last call
+void ChanStart(int ch, int sv, double lo_shift, double ca_shift);   // CaSignals[sv] from next block
+void ChanSamples(const unsigned char *rx, int n);                   // n samples in capture format
+bool ChanSnapshot(int ch, SNAPSHOT *rep);                           // clock replica at end of last block
 
 //////////////////////////////////////////////////////////////
 // Solution
 
-void SolveTask();
+void SolveEpoch(double t); // fix from all channels, t seconds into capture
 
 //////////////////////////////////////////////////////////////
 // User interface
@@ -8,6 +8,7 @@
 
 #include "gps.h"
 #include "spi.h"
+#include "perf.h"
 
 ///////////////////////////////////////////////////////////////////////////////////////////////
 
@@ -55,6 +56,8 @@ int main(int argc, char *argv[]) {
         return ret;
     }
 
+    PerfInit(0); // stage counters on SIGUSR1
+
     ret = SearchInit();
     if (ret) {
         printf("SearchInit() returned %d\n", ret);
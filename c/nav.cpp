@@ -0,0 +1,74 @@
+///////////////////////////////////////////////////////////////////////////////////////////////
+// Homemade GPS Receiver
+// Copyright (c) Andrew Holme 2011-2013
+// http://www.holmea.demon.co.uk/GPS/Main.htm
+///////////////////////////////////////////////////////////////////////////////////////////////
+
+#include "nav.h"
+
+///////////////////////////////////////////////////////////////////////////////////////////////
+// ICD-GPS-200 parity: D25 ... D30 each the XOR of D29* or D30* and 13 to 15 data bits,
+// so one AND and popcount apiece over the whole 32-bit window.
+
+static const uint32_t ParityMask[6] = {
+    0xBB1F3480, // D25 = D29* ^ d1 d2 d3 d5 d6 d10 d11 d12 d13 d14 d17 d18 d20 d23
+    0x5D8F9A40, // D26 = D30* ^ d2 d3 d4 d6 d7 d11 d12 d13 d14 d15 d18 d19 d21 d24
+    0xAEC7CD00, // D27 = D29* ^ d1 d3 d4 d5 d7 d8 d12 d13 d14 d15 d16 d19 d20 d22
+    0x5763E680, // D28 = D30* ^ d2 d4 d5 d6 d8 d9 d13 d14 d15 d16 d17 d20 d21 d23
+    0x6BB1F340, // D29 = D30* ^ d1 d3 d5 d6 d7 d9 d10 d14 d15 d16 d17 d18 d21 d22 d24
+    0x8B7A89C0  // D30 = D29* ^ d3 d5 d6 d8 d9 d10 d11 d13 d15 d19 d22 d23 d24
+};
+
+int NavParity(uint32_t w) {
+    uint32_t p=0;
+    for (int i=0; i<6; i++) p += p + (__builtin_popcount(w & ParityMask[i]) & 1);
+    return p ^ (w & 0x3F);
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////
+
+const uint32_t PREAMBLE = 0x8B;
+
+static uint32_t Word(uint64_t sr) { // last 30 bits plus the two before, data un-inverted
+    uint32_t w = uint32_t(sr);
+    return w>>30&1? w ^ 0x3FFFFFC0 : w;
+}
+
+void NAV_DECODER::Reset() {
+    sr = 0;
+    held = words = 0;
+}
+
+int NAV_DECODER::Push(int bit) {
+    sr += sr + (bit&1);
+    if (++held%30) return NAV_NONE;
+
+    if (!words) {
+        // Upright or inverted preamble?  Setting of parity bits resolves phase ambiguity:
+        // take D29* = D30* = 0 upright, 1 inverted, whatever came before.
+        uint32_t pre = uint32_t(sr>>22) & 0xFF;
+        uint64_t tlm;
+        if      (pre==PREAMBLE)         tlm = sr & 0x3FFFFFFF;
+        else if (pre==(PREAMBLE^0xFF))  tlm = sr | 0xC0000000;
+        else {
+            held--; // slide one bit
+            return NAV_NONE;
+        }
+        sub[words++] = Word(tlm);
+        if (NavParity(sub[0])) {
+            held = words = 0;
+            return NAV_PARITY;
+        }
+        return NAV_NONE;
+    }
+
+    sub[words] = Word(sr);
+    if (NavParity(sub[words])) { // drop the subframe up to here and look for the next
+        held = words = 0;
+        return NAV_PARITY;
+    }
+    if (++words<10) return NAV_NONE;
+
+    held = words = 0;
+    return NAV_OK;
+}
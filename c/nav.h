@@ -0,0 +1,29 @@
+///////////////////////////////////////////////////////////////////////////////////////////////
+// Homemade GPS Receiver
+// Copyright (c) Andrew Holme 2011-2013
+// http://www.holmea.demon.co.uk/GPS/Main.htm
+///////////////////////////////////////////////////////////////////////////////////////////////
+
+#include <stdint.h>
+
+///////////////////////////////////////////////////////////////////////////////////////////////
+// NAV data words bit-packed: D1 in bit 29 ... D30 in bit 0
+
+// Parity of the word in bits 29...0 of w, given D29, D30 of the previous word in bits 31, 30.
+// Data bits must already be un-inverted.  Returns 0 if it matches D25...D30.
+int NavParity(uint32_t w);
+
+enum NAV_CHECK { NAV_NONE, NAV_OK, NAV_PARITY };
+
+// NAV bit stream to subframes.  Bits go through a shift register, where an upright or
+// inverted preamble starts a subframe; each word is un-inverted and parity checked as it
+// completes, so nothing is held or slid along but the register.
+struct NAV_DECODER {
+    uint64_t sr;                    // Bits received, newest in bit 0
+    int      held;                  // Bits since the last subframe edge, as channel.cpp's holding
+    int      words;                 // Words of this subframe through parity
+    uint32_t sub[10];               // ... un-inverted, D29 and D30 of the word before in bits 31, 30
+
+    void Reset();
+    int  Push(int bit);             // NAV_OK: sub[] holds a subframe; NAV_PARITY: bad word
+};
@@ -0,0 +1,151 @@
+///////////////////////////////////////////////////////////////////////////////////////////////
+// Homemade GPS Receiver
+// Copyright (c) Andrew Holme 2011-2013
+// http://www.holmea.demon.co.uk/GPS/Main.htm
+///////////////////////////////////////////////////////////////////////////////////////////////
+
+#include <stdlib.h>
+#include <pthread.h>
+#include <signal.h>
+#include <time.h>
+
+#include "perf.h"
+
+#ifndef NO_PERF
+
+///////////////////////////////////////////////////////////////////////////////////////////////
+
+struct PERF_BLOCK {                 // One per thread; written by that thread only
+    uint64_t calls[PERF_STAGES], ticks[PERF_STAGES], items[PERF_STAGES];
+    PERF_BLOCK *next;
+};
+
+static const char *Names[PERF_STAGES] = {
+    "read", "unpack", "fft", "multiply", "inverse", "power", "peak", "track", "parity", "solve"
+};
+
+static PERF_BLOCK *perf_blocks;     // All threads ever, never freed: totals outlive threads
+static __thread PERF_BLOCK *perf_self;
+
+static uint64_t perf_tick0;         // Reference for ticks -> ns
+static double   perf_sec0;
+static double   perf_interval;
+
+///////////////////////////////////////////////////////////////////////////////////////////////
+
+static double Now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec*1e-9;
+}
+
+#if !defined(__x86_64__) && !defined(__i386__)
+uint64_t PerfTicks() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec*1000000000ULL + ts.tv_nsec;
+}
+#endif
+
+static void Reference() {
+    perf_sec0  = Now();
+    perf_tick0 = PerfTicks();
+}
+
+static double NsPerTick() { // TSC rate measured since Reference()
+    double ns = (Now()-perf_sec0)*1e9;
+    uint64_t ticks = PerfTicks()-perf_tick0;
+    return ticks? ns/ticks : 1;
+}
+
+static PERF_BLOCK *Self() {
+    if (perf_self) return perf_self;
+
+    PERF_BLOCK *b = (PERF_BLOCK *) calloc(1, sizeof(PERF_BLOCK));
+    if (!b) abort();
+
+    // Lock-free push
+    b->next = __atomic_load_n(&perf_blocks, __ATOMIC_RELAXED);
+    while (!__atomic_compare_exchange_n(&perf_blocks, &b->next, b, true, __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+
+    if (!perf_tick0) Reference();
+    return perf_self = b;
+}
+
+// Single writer: plain add, atomic store so readers never see a torn count
+static inline void Bump(uint64_t *p, uint64_t n) {
+    __atomic_store_n(p, *p+n, __ATOMIC_RELAXED);
+}
+
+void PerfAdd(int stage, uint64_t ticks) {
+    PERF_BLOCK *b = Self();
+    Bump(b->calls+stage, 1);
+    Bump(b->ticks+stage, ticks);
+}
+
+void PerfItems(int stage, uint64_t n) {
+    Bump(Self()->items+stage, n);
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////
+
+void PerfDump(FILE *fp) {
+    uint64_t calls[PERF_STAGES]={0}, ticks[PERF_STAGES]={0}, items[PERF_STAGES]={0};
+    double ns = NsPerTick();
+
+    for (PERF_BLOCK *b = __atomic_load_n(&perf_blocks, __ATOMIC_ACQUIRE); b; b=b->next)
+        for (int s=0; s<PERF_STAGES; s++) {
+            calls[s] += __atomic_load_n(b->calls+s, __ATOMIC_RELAXED);
+            ticks[s] += __atomic_load_n(b->ticks+s, __ATOMIC_RELAXED);
+            items[s] += __atomic_load_n(b->items+s, __ATOMIC_RELAXED);
+        }
+
+    fprintf(fp, "%-10s %12s %12s %12s %14s %12s\n", "stage", "calls", "total ms", "us/call", "items", "items/s");
+    for (int s=0; s<PERF_STAGES; s++) {
+        if (!calls[s]) continue;
+        double t = ticks[s]*ns*1e-9;
+        fprintf(fp, "%-10s %12llu %12.1f %12.2f", Names[s], (unsigned long long) calls[s], t*1e3, t*1e6/calls[s]);
+        if (items[s]) fprintf(fp, " %14llu %12.4g", (unsigned long long) items[s], items[s]/t);
+        fprintf(fp, "\n");
+    }
+    fflush(fp);
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////
+
+static void *PerfThread(void *) {
+    sigset_t set;
+    sigemptyset(&set);
+    sigaddset(&set, SIGUSR1);
+
+    for (;;) {
+        if (perf_interval>0) {
+            struct timespec ts;
+            ts.tv_sec  = time_t(perf_interval);
+            ts.tv_nsec = long((perf_interval-ts.tv_sec)*1e9);
+            sigtimedwait(&set, NULL, &ts);
+        }
+        else
+            sigwaitinfo(&set, NULL);
+        PerfDump(stderr);
+    }
+    return NULL;
+}
+
+void PerfInit(double interval) {
+    sigset_t set;
+    pthread_t thread;
+
+    perf_interval = interval;
+    Reference();
+
+    // Only the dump thread takes SIGUSR1
+    sigemptyset(&set);
+    sigaddset(&set, SIGUSR1);
+    pthread_sigmask(SIG_BLOCK, &set, NULL);
+
+    if (pthread_create(&thread, NULL, PerfThread, NULL)==0)
+        pthread_detach(thread);
+}
+
+#endif
@@ -0,0 +1,67 @@
+///////////////////////////////////////////////////////////////////////////////////////////////
+// Homemade GPS Receiver
+// Copyright (c) Andrew Holme 2011-2013
+// http://www.holmea.demon.co.uk/GPS/Main.htm
+///////////////////////////////////////////////////////////////////////////////////////////////
+
+#include <stdio.h>
+#include <stdint.h>
+
+///////////////////////////////////////////////////////////////////////////////////////////////
+// Hot-path counters: calls, time and items (samples, bins, words) per stage.
+// Each thread adds to its own block; PerfDump() sums the blocks as it reads.
+// Build with -DNO_PERF and the PERF macros compile to nothing.
+
+enum PERF_STAGE {
+    PERF_READ,      // Sample read: file view, stream ring or SPI
+    PERF_UNPACK,    // Unpack and mix to baseband
+    PERF_FFT,       // Forward FFT
+    PERF_MULTIPLY,  // Doppler-shifted products
+    PERF_INVERSE,   // Inverse FFTs
+    PERF_POWER,     // |r|^2, summed over blocks
+    PERF_PEAK,      // Peak search
+    PERF_TRACK,     // Software channel correlators, items = samples x channels
+    PERF_PARITY,    // NAV decoding, items = subframes
+    PERF_SOLVE,     // Navigation solution
+    PERF_STAGES
+};
+
+#ifdef NO_PERF
+
+#define PERF(stage)
+#define PERF_ITEMS(stage, n)
+
+static inline void PerfInit(double) {}
+static inline void PerfDump(FILE *) {}
+
+#else
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+static inline uint64_t PerfTicks() { return __rdtsc(); }
+#else
+uint64_t PerfTicks();               // clock_gettime, ns
+#endif
+
+void PerfAdd(int stage, uint64_t ticks);      // One call
+void PerfItems(int stage, uint64_t n);
+
+struct PERF_SCOPE {                 // Times its own lifetime
+    int stage;
+    uint64_t t0;
+    PERF_SCOPE(int s) : stage(s), t0(PerfTicks()) {}
+    ~PERF_SCOPE() { PerfAdd(stage, PerfTicks()-t0); }
+};
+
+#define PERF_CAT(a, b) a##b
+#define PERF_VAR(line) PERF_CAT(perf_scope_, line)
+
+#define PERF(stage)             PERF_SCOPE PERF_VAR(__LINE__)(stage)    // Time rest of scope
+#define PERF_ITEMS(stage, n)    PerfItems(stage, n)                     // Count work done
+
+// Dump on SIGUSR1, and every interval seconds if > 0.  Call before starting
+// other threads: they inherit the blocked signal.
+void PerfInit(double interval);
+void PerfDump(FILE *fp);
+
+#endif
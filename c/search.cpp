@@ -11,47 +11,11 @@
 #include "gps.h"
 #include "spi.h"
 #include "cacode.h"
+#include "perf.h"
 
 ///////////////////////////////////////////////////////////////////////////////////////////////
 
-struct SATELLITE {
-    int prn, navstar, T1, T2;
-};
-
-static const SATELLITE Sats[NUM_SATS] = {
-     1,  63,  2,  6,
-     2,  56,  3,  7,
-     3,  37,  4,  8,
-     4,  35,  5,  9,
-     5,  64,  1,  9,
-     6,  36,  2, 10,
-     7,  62,  1,  8,
-     8,  44,  2,  9,
-     9,  33,  3, 10,
-    10,  38,  2,  3,
-    11,  46,  3,  4,
-    12,  59,  5,  6,
-    13,  43,  6,  7,
-    14,  49,  7,  8,
-    15,  60,  8,  9,
-    16,  51,  9, 10,
-    17,  57,  1,  4,
-    18,  50,  2,  5,
-    19,  54,  3,  6,
-    20,  47,  4,  7,
-    21,  52,  5,  8,
-    22,  53,  6,  9,
-    23,  55,  1,  3,
-    24,  23,  4,  6,
-    25,  24,  5,  7,
-    26,  26,  6,  8,
-    27,  27,  7,  9,
-    28,  48,  8, 10,
-    29,  61,  1,  6,
-    30,  39,  2,  7,
-    31,  58,  3,  8,
-    32,  22,  4,  9,
-};
+// The FPGA code generator takes G2 taps: GPS PRN 1 ... NUM_SATS, CaSignals[sv]
 
 static bool Busy[NUM_SATS];
 
@@ -70,6 +34,12 @@ float inline Bipolar(int bit) {
     return bit? -1.0 : +1.0;
 }
 
+// Offset of the vertex of a parabola through (-1,a), (0,b), (1,c) from the middle point
+static double Vertex(double a, double b, double c) {
+    double d = a - 2*b + c;
+    return d<0? MAX(-0.5, MIN(0.5, 0.5*(a-c)/d)) : 0;
+}
+
 ///////////////////////////////////////////////////////////////////////////////////////////////
 
 int SearchInit() {
@@ -81,22 +51,22 @@ int SearchInit() {
 
     for (int sv=0; sv<NUM_SATS; sv++) {
 
-        CACODE ca(Sats[sv].T1, Sats[sv].T2);
+        int chip_i=0; // CA_LEN periodic
         float ca_phase=0;
 
         for (int i=0; i<FFT_LEN; i++) {
 
-            float chip = Bipolar(ca.Chip()); // chip at start of sample period
+            float chip = Bipolar(CaChip(sv, chip_i)); // chip at start of sample period
 
             ca_phase += ca_rate; // NCO phase at end of period
 
             if (ca_phase >= 1.0) { // reached or crossed chip boundary?
                 ca_phase -= 1.0;
-                ca.Clock();
+                if (++chip_i==CA_LEN) chip_i=0;
 
                 // These two lines do not make much difference
                 chip *= 1.0 - ca_phase;                 // prev chip
-                chip += ca_phase * Bipolar(ca.Chip());  // next chip
+                chip += ca_phase * Bipolar(CaChip(sv, chip_i));  // next chip
             }
 
             fwd_buf[i][0] = chip;
@@ -136,7 +106,12 @@ static void Sample() {
 
     while (i<FFT_LEN) {
         SPI_MISO rx;
-        spi_get(CmdGetSamples, &rx, PACKET);
+        {
+            PERF(PERF_READ);
+            spi_get(CmdGetSamples, &rx, PACKET);
+        }
+        PERF(PERF_UNPACK);
+        PERF_ITEMS(PERF_UNPACK, PACKET*8);
         for (j=0; j<PACKET; j++) {
 
             int byte = rx.byte[j];
@@ -155,33 +130,46 @@ static void Sample() {
         }
     }
 
-    fftwf_execute(fwd_plan); // Transform to frequency domain
+    {
+        PERF(PERF_FFT);
+        fftwf_execute(fwd_plan); // Transform to frequency domain
+    }
+    PERF_ITEMS(PERF_FFT, FFT_LEN);
     NextTask();
 }
 
 ///////////////////////////////////////////////////////////////////////////////////////////////
 
-static float Correlate(int sv, int *max_snr_dop, int *max_snr_i) {
+static float Correlate(int sv, double *max_snr_dop, double *max_snr_i) { // bins, samples: refined
+
+    const int MAX_BIN = 5000*FFT_LEN/FS;
 
     fftwf_complex *data = fwd_buf;
     fftwf_complex *prod = rev_buf;
-    float max_snr=0;
-    int i;
+    float max_snr=0, bin_snr[2*MAX_BIN+1];
+    int i, max_dop=0;
 
-    for (int dop=-5000*FFT_LEN/FS; dop<=5000*FFT_LEN/FS; dop++) {
+    for (int dop=-MAX_BIN; dop<=MAX_BIN; dop++) {
         float max_pwr=0, tot_pwr=0;
         int max_pwr_i;
 
         // (a-ib)(x+iy) = (ax+by) + i(ay-bx)
-        for (i=0; i<FFT_LEN; i++) {
-            int j=(i-dop+FFT_LEN)%FFT_LEN;
-            prod[i][0] = data[i][0]*code[sv][j][0] + data[i][1]*code[sv][j][1];
-            prod[i][1] = data[i][0]*code[sv][j][1] - data[i][1]*code[sv][j][0];
+        {
+            PERF(PERF_MULTIPLY);
+            for (i=0; i<FFT_LEN; i++) {
+                int j=(i-dop+FFT_LEN)%FFT_LEN;
+                prod[i][0] = data[i][0]*code[sv][j][0] + data[i][1]*code[sv][j][1];
+                prod[i][1] = data[i][0]*code[sv][j][1] - data[i][1]*code[sv][j][0];
+            }
         }
 
-        fftwf_execute(rev_plan);
+        {
+            PERF(PERF_INVERSE);
+            fftwf_execute(rev_plan);
+        }
         NextTask();
 
+        PERF(PERF_PEAK);
         for (i=0; i<FS/1000; i++) {
             float pwr = prod[i][0]*prod[i][0] + prod[i][1]*prod[i][1];
             if (pwr>max_pwr) max_pwr=pwr, max_pwr_i=i;
@@ -189,18 +177,29 @@ static float Correlate(int sv, int *max_snr_dop, int *max_snr_i) {
         }
 
         float ave_pwr = tot_pwr/i;
-        float snr = max_pwr/ave_pwr;
-        if (snr>max_snr) max_snr=snr, *max_snr_dop=dop, *max_snr_i=max_pwr_i;
+        float snr = bin_snr[dop+MAX_BIN] = max_pwr/ave_pwr;
+        if (snr>max_snr) {
+            // Code phase between samples, from the neighbours of the peak
+            int lo = (max_pwr_i+FFT_LEN-1)%FFT_LEN, hi = (max_pwr_i+1)%FFT_LEN;
+            float pwr_lo = prod[lo][0]*prod[lo][0] + prod[lo][1]*prod[lo][1];
+            float pwr_hi = prod[hi][0]*prod[hi][0] + prod[hi][1]*prod[hi][1];
+            max_snr=snr, max_dop=dop, *max_snr_i=max_pwr_i+Vertex(pwr_lo, max_pwr, pwr_hi);
+        }
+    }
+
+    // Doppler between bins, from the neighbouring bins
+    *max_snr_dop = max_dop;
+    if (max_dop>-MAX_BIN && max_dop<MAX_BIN) {
+        float *s = bin_snr+max_dop+MAX_BIN;
+        *max_snr_dop += Vertex(s[-1], s[0], s[1]);
     }
     return max_snr;
 }
 
 ///////////////////////////////////////////////////////////////////////////////////////////////
 
-int SearchCode(int sv, int g1) { // Could do this with look-up tables
-    int chips=0;
-    for (CACODE ca(Sats[sv].T1, Sats[sv].T2); ca.GetG1()!=g1; ca.Clock()) chips++;
-    return chips;
+int SearchCode(int /*sv*/, int g1) { // G1 is common to all SVs: sv is not needed
+    return CaTable.g1_chip[g1 & 0x3FF];
 }
 
 ///////////////////////////////////////////////////////////////////////////////////////////////
@@ -212,7 +211,8 @@ void SearchEnable(int sv) {
 ///////////////////////////////////////////////////////////////////////////////////////////////
 
 void SearchTask() {
-    int ch, sv, t_sample, lo_shift, ca_shift;
+    int ch, sv, t_sample;
+    double lo_shift, ca_shift;
     float snr;
 
     for(;;)
@@ -227,13 +227,13 @@ void SearchTask() {
             Sample();
             snr = Correlate(sv, &lo_shift, &ca_shift);
 
-//            UserStat(STAT_PRN, snr, Sats[sv].prn);
+//            UserStat(STAT_PRN, snr, CaSignals[sv].prn);
 
             if (snr<25)
                 continue;
 
             Busy[sv] = true;
-            ChanStart(ch, sv, t_sample, (Sats[sv].T1<<4) +
-                                         Sats[sv].T2, lo_shift, ca_shift);
+            ChanStart(ch, sv, t_sample, (CaSignals[sv].t1<<4) +
+                                         CaSignals[sv].t2, lo_shift, ca_shift);
         }
 }
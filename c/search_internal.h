@@ -0,0 +1,65 @@
+///////////////////////////////////////////////////////////////////////////////////////////////
+// Homemade GPS Receiver
+// Copyright (c) Andrew Holme 2011-2013
+// http://www.holmea.demon.co.uk/GPS/Main.htm
+///////////////////////////////////////////////////////////////////////////////////////////////
+
+#include <pthread.h>
+#include <fftw3.h>
+
+///////////////////////////////////////////////////////////////////////////////////////////////
+// Acquisition engine internals, for gps_bench to time each stage on its own.
+// Not for the receiver: it goes through SearchInit(), SearchTask() and ReceiveTask().
+
+struct SOURCE;
+
+struct BIN {                        // Result of one (SV, Doppler) work item
+    float snr;
+    int i;                          // Code phase of peak
+    float frac;                     // Interpolated offset from i, samples
+};
+
+struct WORKER {
+    fftwf_complex *prod;            // Private scratch: batch of Doppler products ...
+    fftwf_plan rev_plan, rev_many;  // ... and inverse FFT plans for one and for a batch
+    fftwf_plan dec_plan, dec_many;  // Same at DEC_LEN for the coarse stage
+    float *acc;                     // [batch][FS/1000] power summed over blocks
+    pthread_t thread;
+    pthread_mutex_t lock;           // Guards head, tail
+    int head, tail;                 // Work items [head, tail) still queued
+
+    void Products(int k, int b0, int n, const fftwf_complex *data);
+    void Inverse(int n);
+    void Accumulate(int n, int blk);
+    void Peak(int k, int b0, int n);
+    void Correlate(int item);
+    int  Pop();
+    int  Steal(int n);
+    void Work();
+};
+
+struct FORMAT_DEF {
+    int bits; // per sample
+    void (*decode)(fftwf_complex *buf, const unsigned char *rx); // FFT_LEN samples
+};
+
+extern const FORMAT_DEF Formats[];  // indexed by FORMAT
+
+extern int NumSats;                 // PRNs enabled, sv = 0 ... NumSats-1
+extern fftwf_complex *code[];       // Code spectra by sv
+extern fftwf_complex *fwd_buf;      // Data spectra
+extern fftwf_plan fwd_plan;
+extern int DEC;                     // Coarse stage decimation
+extern const char *simd_name;       // Kernels in use, from SearchInit()
+
+extern WORKER *Workers;
+extern int NumWorkers;
+
+extern int job_sv[], job_dop[];     // Current job: SVs, lowest Doppler bin per SV
+extern int job_bins, job_dec, job_blks;
+
+double         Seconds();
+fftwf_complex *CodeSpectrum(int sv);
+void           Decode1(fftwf_complex *buf, const unsigned char *rx);
+int            Capture(SOURCE &src);
+void           Correlate(int nsv, const int *svs, double t, float *snr, int *max_snr_dop, int *max_snr_i);
@@ -5,63 +5,107 @@
 ///////////////////////////////////////////////////////////////////////////////////////////////
 
 #include <memory.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
 #include <fftw3.h>
 #include <math.h>
 
 #include "gps_offline.h"
 #include "cacode.h"
+#include "simd.h"
+#include "source.h"
+#include "perf.h"
+#include "assist.h"
+#include "search_internal.h"
 
 ///////////////////////////////////////////////////////////////////////////////////////////////
 
-struct SATELLITE {
-    int prn, navstar, T1, T2;
-};
+// PRNs enabled for search, in catalogue order: sv = 0 ... NumSats-1
+
+#define PRN_WORDS ((CA_PRNS+63)/64)
+
+int NumSats;
+static int Cat[CA_PRNS];            // CaSignals[] index of each sv
+static uint64_t cat_set[PRN_WORDS]; // Same, as a set
+
+static inline bool InSet(const uint64_t *set, int i) { return set[i>>6] >> (i&63) & 1; }
+static inline void AddSet(uint64_t *set, int i) { set[i>>6] |= 1ULL << (i&63); }
+
+static bool Busy[CA_PRNS];
+static bool Lost[CA_PRNS];          // Dropped by a channel since the last search, -r
+
+///////////////////////////////////////////////////////////////////////////////////////////////
+
+// Replicas are real, so only bins 0 ... FFT_LEN/2 of their spectra are held;
+// bin j > FFT_LEN/2 is conj(code[FFT_LEN-j]).
+#define CODE_LEN (FFT_LEN/2+1)
+
+fftwf_complex *code[CA_PRNS];       // Code spectra: cache mapping or heap, built on first use
+
+fftwf_complex *fwd_buf;             // Data spectra: noncoh consecutive blocks of FFT_LEN
+static fftwf_complex rep_out[CODE_LEN];
+static float         rep_buf[FFT_LEN];
 
-static const SATELLITE Sats[NUM_SATS] = {
-     {1,  63,  2,  6},
-     {2,  56,  3,  7},
-     {3,  37,  4,  8},
-     {4,  35,  5,  9},
-     {5,  64,  1,  9},
-     {6,  36,  2, 10},
-     {7,  62,  1,  8},
-     {8,  44,  2,  9},
-     {9,  33,  3, 10},
-    {10,  38,  2,  3},
-    {11,  46,  3,  4},
-    {12,  59,  5,  6},
-    {13,  43,  6,  7},
-    {14,  49,  7,  8},
-    {15,  60,  8,  9},
-    {16,  51,  9, 10},
-    {17,  57,  1,  4},
-    {18,  50,  2,  5},
-    {19,  54,  3,  6},
-    {20,  47,  4,  7},
-    {21,  52,  5,  8},
-    {22,  53,  6,  9},
-    {23,  55,  1,  3},
-    {24,  23,  4,  6},
-    {25,  24,  5,  7},
-    {26,  26,  6,  8},
-    {27,  27,  7,  9},
-    {28,  48,  8, 10},
-    {29,  61,  1,  6},
-    {30,  39,  2,  7},
-    {31,  58,  3,  8},
-    {32,  22,  4,  9},
+fftwf_plan fwd_plan;
+static fftwf_plan rep_plan;
+
+const char *simd_name;              // Kernel set chosen by SimdInit()
+
+// Coarse stage of two-stage search: the Doppler-shifted product is cut to the
+// FFT_LEN/DEC bins around the code main lobe, which low-passes and decimates
+// by DEC in one step.  Bin spacing, hence the Doppler grid, is unchanged.
+int DEC = 1;                        // Decimation, ~2 samples per chip
+static int DEC_LEN = FFT_LEN;       // Coarse FFT length
+
+#define FINE_BINS 3                 // Full-rate Doppler bins around each coarse peak
+
+// Assisted search: only SVs predicted above the mask, in a window around their Doppler
+static double aid_t0 = -1;          // GPS seconds of week at start of capture, <0 = unaided
+static int    aid_bin[CA_PRNS];     // Predicted Doppler bin per sv
+static int    aid_half;             // Window half-width, bins
+
+static const int PACKET  = 512;                                     // Capture granularity, bytes
+static const int BLK_ADV = (FFT_LEN/8+PACKET-1)/PACKET * PACKET*8;  // Samples from one block to the next
+
+///////////////////////////////////////////////////////////////////////////////////////////////
+// Code spectra cache file, keyed by (FS, FFT_LEN, PRN set) and mapped read-only
+
+struct CACHE_HDR {
+    char     magic[8];
+    double   fs;
+    int32_t  fft_len, num_sats;
+    uint64_t cat[PRN_WORDS];        // Catalogue entries enabled
+    uint64_t prns[PRN_WORDS];       // Bit sv set if code[sv] is held
 };
 
-static bool Busy[NUM_SATS];
+static const char CACHE_MAGIC[8] = {'G','P','S','C','O','D','E','3'};
+
+static void    *cache_map;
+static size_t   cache_size;
+static uint64_t cache_prns[PRN_WORDS]; // Spectra held in mapping
+static uint64_t built_prns[PRN_WORDS]; // Spectra built on heap since
 
 ///////////////////////////////////////////////////////////////////////////////////////////////
+// Acquisition engine: (SV, Doppler) work items spread over worker threads
 
-static fftwf_complex code[NUM_SATS][FFT_LEN];
+WORKER *Workers;
+int NumWorkers;
 
-static fftwf_complex fwd_buf[FFT_LEN],
-                     rev_buf[FFT_LEN];
+static pthread_barrier_t job_start, job_done;
+static bool job_quit;
 
-static fftwf_plan fwd_plan, rev_plan;
+int  job_sv[CA_PRNS];               // SVs being searched
+int  job_dop[CA_PRNS];              // Lowest Doppler bin per SV
+int  job_bins, job_dec;             // Bins per SV; decimation, 1 = full rate
+int  job_blks;                      // Batches per SV
+static BIN *job_res;                // [SV][Doppler] results
 
 ///////////////////////////////////////////////////////////////////////////////////////////////
 
@@ -69,149 +113,848 @@ float inline Bipolar(int bit) {
     return bit? -1.0 : +1.0;
 }
 
+// Offset of the vertex of a parabola through (-1,a), (0,b), (1,c) from the middle point
+static double Vertex(double a, double b, double c) {
+    double d = a - 2*b + c;
+    return d<0? MAX(-0.5, MIN(0.5, 0.5*(a-c)/d)) : 0;
+}
+
 ///////////////////////////////////////////////////////////////////////////////////////////////
 
-int SearchInit() {
+static void *WorkerThread(void *param) {
+    WORKER *w = (WORKER *) param;
+    for (;;) {
+        pthread_barrier_wait(&job_start);
+        if (job_quit) return NULL;
+        w->Work();
+        pthread_barrier_wait(&job_done);
+    }
+}
 
-    const float ca_rate = CPS/FS;
+static int WorkersInit() {
 
-    fwd_plan = fftwf_plan_dft_1d(FFT_LEN, fwd_buf, fwd_buf, FFTW_FORWARD,  FFTW_ESTIMATE);
-    rev_plan = fftwf_plan_dft_1d(FFT_LEN, rev_buf, rev_buf, FFTW_BACKWARD, FFTW_ESTIMATE);
+    NumWorkers = threads>0? threads : sysconf(_SC_NPROCESSORS_ONLN);
+    if (NumWorkers<1) NumWorkers=1;
+    if (batch<1) batch=1;
 
-    for (int sv=0; sv<NUM_SATS; sv++) {
+    int bins = 2*int(max_fo*FFT_LEN/FS) + 1;
+    job_res = (BIN *) malloc(NumSats * bins * sizeof(BIN));
+    Workers = (WORKER *) calloc(NumWorkers, sizeof(WORKER));
+    if (!job_res || !Workers) return -1;
 
-        CACODE ca(Sats[sv].T1, Sats[sv].T2);
-        float ca_phase=0;
+    pthread_barrier_init(&job_start, NULL, NumWorkers);
+    pthread_barrier_init(&job_done,  NULL, NumWorkers);
 
-        for (int i=0; i<FFT_LEN; i++) {
+    // FFTW planner is not thread-safe: make every plan here, up front
+    for (int n=0; n<NumWorkers; n++) {
+        WORKER *w = Workers+n;
+        int n_fft = FFT_LEN;
+        w->prod = (fftwf_complex *) fftwf_malloc(sizeof(fftwf_complex) * FFT_LEN * batch);
+        w->acc  = (float *) malloc(sizeof(float) * int(FS/1000) * batch);
+        if (!w->prod || !w->acc) return -2;
+        w->rev_plan = fftwf_plan_dft_1d(FFT_LEN, w->prod, w->prod, FFTW_BACKWARD, planner);
+        w->rev_many = fftwf_plan_many_dft(1, &n_fft, batch,
+                                          w->prod, NULL, 1, FFT_LEN,
+                                          w->prod, NULL, 1, FFT_LEN, FFTW_BACKWARD, planner);
+        if (DEC>1) {
+            n_fft = DEC_LEN;
+            w->dec_plan = fftwf_plan_dft_1d(DEC_LEN, w->prod, w->prod, FFTW_BACKWARD, planner);
+            w->dec_many = fftwf_plan_many_dft(1, &n_fft, batch,
+                                              w->prod, NULL, 1, DEC_LEN,
+                                              w->prod, NULL, 1, DEC_LEN, FFTW_BACKWARD, planner);
+        }
+        pthread_mutex_init(&w->lock, NULL);
+    }
 
-            float chip = Bipolar(ca.Chip()); // chip at start of sample period
+    // Worker 0 is the search thread itself
+    for (int n=1; n<NumWorkers; n++)
+        if (pthread_create(&Workers[n].thread, NULL, WorkerThread, Workers+n)) return -3;
 
-            ca_phase += ca_rate; // NCO phase at end of period
+    return 0;
+}
 
-            if (ca_phase >= 1.0) { // reached or crossed chip boundary?
-                ca_phase -= 1.0;
-                ca.Clock();
+///////////////////////////////////////////////////////////////////////////////////////////////
 
-                // These two lines do not make much difference
-                chip *= 1.0 - ca_phase;                 // prev chip
-                chip += ca_phase * Bipolar(ca.Chip());  // next chip
-            }
+static void CachePath(char *path, const char *name) {
+    sprintf(path, "%s/%s", cache_dir, name);
+}
 
-            fwd_buf[i][0] = chip;
-            fwd_buf[i][1] = 0;
-        }
+static void CacheOpen() {
+    char path[1024];
+    char name[64];
+    struct stat st;
+    CACHE_HDR *hdr;
+
+    sprintf(name, "gps_code_%.0f_%d.bin", FS, FFT_LEN);
+    CachePath(path, name);
 
-        fftwf_execute(fwd_plan);
-        memcpy(code[sv], fwd_buf, sizeof fwd_buf);
+    int fd = open(path, O_RDONLY);
+    if (fd<0) return; // first run
+
+    cache_size = fstat(fd, &st)? 0 : st.st_size;
+    if (cache_size == sizeof(CACHE_HDR) + sizeof(fftwf_complex)*NumSats*CODE_LEN)
+        cache_map = mmap(NULL, cache_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+
+    if (!cache_map || cache_map==MAP_FAILED) {
+        cache_map = NULL;
+        return;
     }
 
-    return 0;
+    hdr = (CACHE_HDR *) cache_map;
+    if (memcmp(hdr->magic, CACHE_MAGIC, 8) || hdr->fs!=FS || hdr->fft_len!=FFT_LEN || hdr->num_sats!=NumSats
+                                                                   || memcmp(hdr->cat, cat_set, sizeof cat_set)) {
+        printf("code cache %s does not match, rebuilding\n", path);
+        munmap(cache_map, cache_size);
+        cache_map = NULL;
+        return;
+    }
+
+    memcpy(cache_prns, hdr->prns, sizeof cache_prns);
+    fftwf_complex *spectra = (fftwf_complex *) (hdr+1);
+    for (int sv=0; sv<NumSats; sv++)
+        if (InSet(cache_prns, sv)) code[sv] = spectra + sv*CODE_LEN;
+}
+
+static void CacheSave() { // write mapped + newly built spectra to a new file, then swap it in
+    char path[1024], temp[1024+4];
+    char name[64];
+    CACHE_HDR hdr;
+
+    sprintf(name, "gps_code_%.0f_%d.bin", FS, FFT_LEN);
+    CachePath(path, name);
+    sprintf(temp, "%s.tmp", path);
+
+    FILE *fp = fopen(temp, "wb");
+    if (!fp) {
+        printf("can not write code cache %s\n", temp);
+        return;
+    }
+
+    memcpy(hdr.magic, CACHE_MAGIC, 8);
+    hdr.fs = FS;
+    hdr.fft_len = FFT_LEN;
+    hdr.num_sats = NumSats;
+    memcpy(hdr.cat, cat_set, sizeof cat_set);
+    for (int w=0; w<PRN_WORDS; w++) hdr.prns[w] = cache_prns[w] | built_prns[w];
+
+    static const fftwf_complex zero[CODE_LEN] = {};
+    int ok = fwrite(&hdr, sizeof hdr, 1, fp);
+    for (int sv=0; sv<NumSats; sv++)
+        ok &= fwrite(code[sv]? code[sv] : zero, sizeof zero, 1, fp);
+
+    if (fclose(fp)==0 && ok) rename(temp, path);
+    else unlink(temp);
 }
 
 ///////////////////////////////////////////////////////////////////////////////////////////////
 
-void SearchFree() {
-    fftwf_destroy_plan(fwd_plan);
-    fftwf_destroy_plan(rev_plan);
+fftwf_complex *CodeSpectrum(int sv) { // called on search thread only
+
+    const float ca_rate = CPS/FS;
+
+    if (code[sv]) return code[sv];
+
+    int chip_i=0; // CA_LEN periodic
+    float ca_phase=0;
+
+    for (int i=0; i<FFT_LEN; i++) {
+
+        float chip = Bipolar(CaChip(Cat[sv], chip_i)); // chip at start of sample period
+
+        ca_phase += ca_rate; // NCO phase at end of period
+
+        if (ca_phase >= 1.0) { // reached or crossed chip boundary?
+            ca_phase -= 1.0;
+            if (++chip_i==CA_LEN) chip_i=0;
+
+            // These two lines do not make much difference
+            chip *= 1.0 - ca_phase;                 // prev chip
+            chip += ca_phase * Bipolar(CaChip(Cat[sv], chip_i));  // next chip
+        }
+
+        rep_buf[i] = chip;
+    }
+
+    fftwf_execute(rep_plan);
+
+    code[sv] = (fftwf_complex *) fftwf_malloc(sizeof rep_out);
+    memcpy(code[sv], rep_out, sizeof rep_out);
+    AddSet(built_prns, sv);
+    return code[sv];
 }
 
 ///////////////////////////////////////////////////////////////////////////////////////////////
+// Down convert to complex (IQ) baseband: x * exp(-j*2*pi*FC/FS*n).
+// The NCO is a 32-bit phase accumulator, one turn = 2^32.
+//
+// Real IF, 1 or 2 bits: mix (XOR) with quadrature square-wave local
+// oscillators, top 2 phase bits = LO quadrant, one table lookup per byte.
+// The table is keyed by the top 5 phase bits at the first sample of the byte.
+//
+// Complex IQ, 8 or 16 bits: remove the block mean (DC), then rotate by an
+// NCO looked up on the top LO_BITS phase bits.
+
+#define LO_STATES 32
+#define LO_BITS   10
 
-static int Sample(FILE *fp) {
+static signed char unpack1[LO_STATES][256][16]; // [phase][byte] -> 8 x (I, Q) = +/-1
+static signed char unpack2[LO_STATES][256][8];  // [phase][byte] -> 4 x (I, Q) = +/-1, +/-3
+static float       lo_tab[1<<LO_BITS][2];       // cos, -sin
+static uint32_t    lo_inc;                      // NCO increment per sample
+
+static void UnpackInit() {
 //    const int lo_sin[] = {1,1,0,0}; // Quadrature local oscillators
 //    const int lo_cos[] = {1,0,0,1};
     const int lo_sin[] = {1,1,0,0}; // Quadrature local oscillators
     const int lo_cos[] = {0,1,1,0};
 
-    const float lo_rate = 4*FC/FS; // NCO rate
+    // FC is negative for IQ tuned above L1: wrap to [0,1) cycles per sample first
+    double f = FC/FS - floor(FC/FS);
+    lo_inc = uint32_t(uint64_t(f * 4294967296.0 + 0.5)); // 1.0 rounds to 0
+
+    for (int s=0; s<LO_STATES; s++)
+        for (int byte=0; byte<256; byte++) {
+            for (int k=0; k<8; k++) {
+                uint32_t phase = (uint32_t(s)<<27) + k*lo_inc;
+                int bit = (byte>>k)&1;
+                unpack1[s][byte][2*k+0] = Bipolar(bit ^ lo_cos[phase>>30]);
+                unpack1[s][byte][2*k+1] = Bipolar(bit ^ lo_sin[phase>>30]);
+            }
+            for (int k=0; k<4; k++) {
+                uint32_t phase = (uint32_t(s)<<27) + k*lo_inc;
+                int sign = (byte>>(2*k))&1, mag = (byte>>(2*k+1))&1 ? 3 : 1;
+                unpack2[s][byte][2*k+0] = mag * Bipolar(sign ^ lo_cos[phase>>30]);
+                unpack2[s][byte][2*k+1] = mag * Bipolar(sign ^ lo_sin[phase>>30]);
+            }
+        }
+
+    for (int i=0; i < 1<<LO_BITS; i++) {
+        double theta = 2*PI*(i+0.5)/(1<<LO_BITS);
+        lo_tab[i][0] =  cos(theta);
+        lo_tab[i][1] = -sin(theta);
+    }
+}
+
+static inline uint32_t LoState(uint32_t lo_phase) { // nearest of LO_STATES
+    return ((lo_phase + (1<<26)) >> 27) % LO_STATES;
+}
+
+// Packed 1-bit real IF, 8 samples per byte, LSB first, 1 = negative
+void Decode1(fftwf_complex *buf, const unsigned char *rx) {
+    static signed char iq[2*FFT_LEN];
+    uint32_t lo_phase=0;
 
-    const int PACKET = 512;
+    for (int i=0; i<FFT_LEN; i+=8) {
+        memcpy(iq+2*i, unpack1[LoState(lo_phase)][rx[i/8]], 16);
+        lo_phase += 8*lo_inc;
+    }
+    Widen(buf[0], iq, 2*FFT_LEN);
+}
+
+// Packed 2-bit sign/magnitude real IF, 4 samples per byte, first in bits 1:0.
+// Each sample: bit 0 = sign (1 = negative), bit 1 = magnitude (1 = 3, 0 = 1).
+static void Decode2(fftwf_complex *buf, const unsigned char *rx) {
+    static signed char iq[2*FFT_LEN];
+    uint32_t lo_phase=0;
+
+    for (int i=0; i<FFT_LEN; i+=4) {
+        memcpy(iq+2*i, unpack2[LoState(lo_phase)][rx[i/4]], 8);
+        lo_phase += 4*lo_inc;
+    }
+    Widen(buf[0], iq, 2*FFT_LEN);
+}
+
+static void MixIQ(fftwf_complex *buf) { // buf holds raw IQ
+    double dc_i=0, dc_q=0;
+    for (int i=0; i<FFT_LEN; i++) dc_i+=buf[i][0], dc_q+=buf[i][1];
+    float mi=dc_i/FFT_LEN, mq=dc_q/FFT_LEN;
+
+    uint32_t lo_phase=0;
+    for (int i=0; i<FFT_LEN; i++, lo_phase+=lo_inc) {
+        const float *lo = lo_tab[lo_phase >> (32-LO_BITS)];
+        float re = buf[i][0]-mi, im = buf[i][1]-mq;
+        buf[i][0] = re*lo[0] - im*lo[1];
+        buf[i][1] = re*lo[1] + im*lo[0];
+    }
+}
+
+// rtl-sdr: interleaved I, Q as uint8, offset 128
+static void DecodeRtl(fftwf_complex *buf, const unsigned char *rx) {
+    for (int i=0; i<2*FFT_LEN; i++) buf[0][i] = rx[i]-128;
+    MixIQ(buf);
+}
+
+// HackRF: interleaved I, Q as int8
+static void DecodeHackRF(fftwf_complex *buf, const unsigned char *rx) {
+    Widen(buf[0], (const signed char *) rx, 2*FFT_LEN);
+    MixIQ(buf);
+}
+
+// Interleaved I, Q as little-endian int16
+static void DecodeInt16(fftwf_complex *buf, const unsigned char *rx) {
+    for (int i=0; i<2*FFT_LEN; i++) buf[0][i] = int16_t(rx[2*i] | rx[2*i+1]<<8);
+    MixIQ(buf);
+}
+
+const FORMAT_DEF Formats[] = { // indexed by FORMAT
+    { 1, Decode1},
+    { 2, Decode2},
+    {16, DecodeRtl},
+    {16, DecodeHackRF},
+    {32, DecodeInt16}
+};
+
+///////////////////////////////////////////////////////////////////////////////////////////////
+// Enable the catalogue entries in prns, e.g. "1-32,120-158"; also gps (1-32), sbas, all
 
-    float lo_phase=0; // NCO phase accumulator
-    int i=0, j, k, byte, bit, read_count;
+static int SatsInit() {
+    char list[256], *tok, *save;
+    bool on[CA_PRNS] = {};
 
-    unsigned char rx[PACKET];
-    while (i<FFT_LEN) {
-        read_count = fread(rx, 1, PACKET, fp);
-        if (read_count != PACKET) {
-//          printf("read error!\n");
-          return(1);
+    snprintf(list, sizeof list, "%s", prns? prns : "gps");
+    for (tok=strtok_r(list, ",", &save); tok; tok=strtok_r(NULL, ",", &save)) {
+        int lo, hi, n=0;
+        if      (0==strcmp(tok, "gps"))  lo=1,   hi=32;
+        else if (0==strcmp(tok, "sbas")) lo=120, hi=158;
+        else if (0==strcmp(tok, "all"))  lo=0,   hi=INT32_MAX;
+        else if ((n=sscanf(tok, "%d-%d", &lo, &hi))==1) hi=lo;
+        else if (n!=2) {
+            printf("bad PRN list %s\n", tok);
+            return -1;
         }
-        for (j=0; j<PACKET; j++) {
-
-            byte = rx[j];
-            for (k=i+8; i<k; i++) {
-                bit = byte&1;
-                byte>>=1;
-
-                // Down convert to complex (IQ) baseband by mixing (XORing)
-                // samples with quadrature local oscillators
-//                fwd_buf[i][0] = Bipolar(bit ^ lo_sin[int(lo_phase)]);
-//                fwd_buf[i][1] = Bipolar(bit ^ lo_cos[int(lo_phase)]);
-                fwd_buf[i][0] = Bipolar(bit ^ lo_cos[int(lo_phase)]);
-                fwd_buf[i][1] = Bipolar(bit ^ lo_sin[int(lo_phase)]);
-
-                lo_phase += lo_rate;
-                if (lo_phase>=4) lo_phase-=4;
-            }
+        for (int k=n=0; k<CA_PRNS; k++)
+            if (CaSignals[k].prn>=lo && CaSignals[k].prn<=hi) on[k]=true, n++;
+        if (!n) {
+            printf("no PRN %s in catalogue\n", tok);
+            return -1;
         }
     }
 
-    fftwf_execute(fwd_plan); // Transform to frequency domain
+    for (int k=NumSats=0; k<CA_PRNS; k++)
+        if (on[k]) Cat[NumSats++]=k, AddSet(cat_set, k);
+
+    if (prns) printf("PRNs: %d enabled\n", NumSats);
+    return 0;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////
+
+static int AidInit() {
+    if (!aid_file) return 0;
+
+    int n = AssistLoad(aid_file);
+    if (n<=0) {
+        printf("no ephemerides in %s\n", aid_file);
+        return -1;
+    }
+
+    aid_t0 = AssistTime(aid_time);
+    if (aid_t0<0) {
+        printf("bad GPS time %s\n", aid_time);
+        return -1;
+    }
+
+    AssistPosition(aid_lat, aid_lon, aid_alt);
+    aid_half = int(ceil(aid_window*FFT_LEN/FS));
+
+    printf("Assisted: %d ephemerides, t0 %.0f s of week, Doppler +/-%d bins, mask %.0f deg\n",
+        n, aid_t0, aid_half, aid_mask);
+    return 0;
+}
+
+// SVs above the mask t seconds into the capture; their predicted Doppler to aid_bin[]
+static int Visible(double t, int *svs) {
+    int n=0;
+    for (int sv=0; sv<NumSats; sv++) {
+        double elev, dop;
+        if (!AssistPredict(CaSignals[Cat[sv]].prn, fmod(aid_t0+t, 604800), &elev, &dop)) continue;
+        if (elev<aid_mask) continue;
+        aid_bin[sv] = int(floor(dop*FFT_LEN/FS + 0.5));
+        svs[n++] = sv;
+    }
+    return n;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////
+// Warm start: last acquisition of each catalogue entry, kept in warm_file across runs
+
+#define SNR_HIT  25                 // Acquired
+#define DOP_RATE 1.0                // Worst-case Doppler drift of a fixed receiver, Hz/s
+
+struct WARM {
+    float  snr;                     // 0 = none
+    double hz, chips;               // Doppler, code phase
+    double t;                       // Unix time of capture
+};
+
+static WARM   warm[CA_PRNS];        // By CaSignals index
+static double warm_t0;              // Unix time of start_time into capture, from CaptureTime()
+static int    warm_tries, warm_hits;
+
+static void WarmLoad() {
+    char line[256];
+    int n=0;
+
+    FILE *fp = fopen(warm_file, "r");
+    if (!fp) return; // first run
+
+    while (fgets(line, sizeof line, fp)) {
+        WARM w;
+        int prn;
+        if (sscanf(line, "%d %lf %lf %f %lf", &prn, &w.hz, &w.chips, &w.snr, &w.t)!=5) continue; // # header
+        for (int k=0; k<CA_PRNS; k++)
+            if (CaSignals[k].prn==prn) warm[k]=w, n++;
+    }
+    fclose(fp);
+
+    printf("Warm start: %d SVs from %s\n", n, warm_file);
+}
+
+static void WarmSave() { // to a new file, then swap it in
+    char temp[1024];
+    snprintf(temp, sizeof temp, "%s.tmp", warm_file);
+
+    FILE *fp = fopen(temp, "w");
+    if (!fp) {
+        printf("can not write warm start %s\n", temp);
+        return;
+    }
+
+    int ok = fprintf(fp, "# prn doppler_hz code_chips snr unix_time\n") > 0;
+    for (int k=0; k<CA_PRNS; k++)
+        if (warm[k].snr>0)
+            ok &= fprintf(fp, "%d %.1f %.3f %.1f %.3f\n", CaSignals[k].prn, warm[k].hz, warm[k].chips, warm[k].snr, warm[k].t) > 0;
+
+    if (fclose(fp)==0 && ok) rename(temp, warm_file);
+    else unlink(temp);
+}
+
+// Unix time of start_time into the capture, not of processing it: -T if it is a date, else
+// the file's mtime less its length (files are written as captured), else now for a stream
+static double CaptureTime(const SOURCE &src, const char *filename) {
+    struct stat st;
+
+    double t = AssistUnixTime(aid_time);
+    if (t>=0) return t + start_time;
+    if (!src.stream && stat(filename, &st)==0) return st.st_mtime - src.size*8.0/src.bits/FS + start_time;
+    return time(NULL);
+}
+
+static int WarmHalf(int k, double t) { // window half-width in bins, widened by drift since
+    double age = MAX(0, t-warm[k].t);
+    return int(ceil((aid_window + DOP_RATE*age)*FFT_LEN/FS));
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////
+
+int SearchInit() {
+    char wisdom[1024];
+
+    if (SatsInit()) return -5;
+    if (AidInit()) return -6;
+    if (warm_file) WarmLoad();
+
+    if (cache_dir) {
+        CachePath(wisdom, "gps_fftw.wisdom");
+        fftwf_import_wisdom_from_filename(wisdom);
+        CacheOpen();
+    }
+
+    if (noncoh<1) noncoh=1;
+    fwd_buf = (fftwf_complex *) fftwf_malloc(sizeof(fftwf_complex) * FFT_LEN * noncoh);
+    if (!fwd_buf) return -4;
+
+    fwd_plan = fftwf_plan_dft_1d(FFT_LEN, fwd_buf, fwd_buf, FFTW_FORWARD, planner);
+    rep_plan = fftwf_plan_dft_r2c_1d(FFT_LEN, rep_buf, rep_out, planner);
+
+    simd_name = SimdInit();
+    printf("SIMD kernels: %s\n", simd_name);
+    UnpackInit();
+
+    if (coarse) {
+        for (DEC = MAX(1, int(FS/(2*CPS))); FFT_LEN%DEC; DEC--);
+        DEC_LEN = FFT_LEN/DEC;
+        printf("Coarse stage: %d-point FFT at %.3f Msps\n", DEC_LEN, FS/DEC/1e6);
+    }
+    if (noncoh>1) printf("Integration: %.1f ms coherent x %d non-coherent\n", FFT_LEN*1e3/FS, noncoh);
+
+    int ret = WorkersInit();
+
+    // Plans are made: keep what the planner measured for next time
+    if (cache_dir && !fftwf_export_wisdom_to_filename(wisdom))
+        printf("can not write FFTW wisdom %s\n", wisdom);
+
+    return ret;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////
+
+void SearchFree() {
+    job_quit = true;
+    pthread_barrier_wait(&job_start);
+
+    for (int n=0; n<NumWorkers; n++) {
+        WORKER *w = Workers+n;
+        if (n) pthread_join(w->thread, NULL);
+        pthread_mutex_destroy(&w->lock);
+        fftwf_destroy_plan(w->rev_plan);
+        fftwf_destroy_plan(w->rev_many);
+        if (DEC>1) {
+            fftwf_destroy_plan(w->dec_plan);
+            fftwf_destroy_plan(w->dec_many);
+        }
+        fftwf_free(w->prod);
+        free(w->acc);
+    }
+
+    pthread_barrier_destroy(&job_start);
+    pthread_barrier_destroy(&job_done);
+
+    free(Workers);
+    free(job_res);
+
+    bool built=false;
+    for (int sv=0; sv<NumSats; sv++)
+        if (InSet(built_prns, sv)) built=true;
+    if (cache_dir && built) CacheSave();
+
+    for (int sv=0; sv<NumSats; sv++)
+        if (InSet(built_prns, sv)) fftwf_free(code[sv]);
+    if (cache_map) munmap(cache_map, cache_size);
+
+    fftwf_destroy_plan(fwd_plan);
+    fftwf_destroy_plan(rep_plan);
+    fftwf_free(fwd_buf);
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////
+
+static int Sample(SOURCE &src, fftwf_complex *buf) {
+    const FORMAT_DEF &fmt = Formats[format];
+
+    // BLK_ADV samples on, rest of last packet is skipped (1-bit: as captured)
+    const unsigned char *rx;
+    {
+        PERF(PERF_READ);
+        rx = src.View(size_t(FFT_LEN)*fmt.bits/8, size_t(BLK_ADV)*fmt.bits/8);
+    }
+    if (!rx) return(1);
+
+    {
+        PERF(PERF_UNPACK);
+        fmt.decode(buf, rx);
+    }
+    PERF_ITEMS(PERF_UNPACK, FFT_LEN);
+
+    PERF(PERF_FFT);
+    fftwf_execute_dft(fwd_plan, buf, buf); // Transform to frequency domain
+    PERF_ITEMS(PERF_FFT, FFT_LEN);
 
     return(0);
 //    NextTask();
 }
 
+int Capture(SOURCE &src) { // noncoh consecutive blocks, BLK_ADV samples apart
+    for (int n=0; n<noncoh; n++)
+        if (Sample(src, fwd_buf + n*FFT_LEN)) return(1);
+    return(0);
+}
+
 ///////////////////////////////////////////////////////////////////////////////////////////////
 
-static float Correlate(int sv, int *max_snr_dop, int *max_snr_i) {
+// Stages of one work item: batch of n Doppler bins from b0, for SV job_sv[k]
 
-    fftwf_complex *data = fwd_buf;
-    fftwf_complex *prod = rev_buf;
-    float max_snr=0;
-    int i;
+void WORKER::Products(int k, int b0, int n, const fftwf_complex *data) {
+    const float *c = code[job_sv[k]][0];
+    const int len = FFT_LEN/job_dec;
 
-    for (int dop=( -max_fo*(double)FFT_LEN/(double)FS ); dop<= ( max_fo*(double)FFT_LEN/(double)FS  ); dop++) {
-        float max_pwr=0, tot_pwr=0;
-        int max_pwr_i;
+    PERF(PERF_MULTIPLY);
+    PERF_ITEMS(PERF_MULTIPLY, n);
 
-        // (a-ib)(x+iy) = (ax+by) + i(ay-bx)
-        for (i=0; i<FFT_LEN; i++) {
-            int j=(i-dop+FFT_LEN)%FFT_LEN;
-            prod[i][0] = data[i][0]*code[sv][j][0] + data[i][1]*code[sv][j][1];
-            prod[i][1] = data[i][0]*code[sv][j][1] - data[i][1]*code[sv][j][0];
+    for (int m=0; m<n; m++) {
+        int dop = job_dop[k]+b0+m;
+        fftwf_complex *p = prod + m*len;
+
+        if (job_dec==1) {
+            // prod[m][i] = conj(data[i]) * code[(i-dop) % FFT_LEN] in contiguous spans:
+            // at most four, split where j wraps and where it crosses into the mirrored half
+            int s = (dop%FFT_LEN + FFT_LEN) % FFT_LEN;
+            for (int i=0, l; i<FFT_LEN; i+=l) {
+                int j = i<s? i-s+FFT_LEN : i-s;
+                if (j<CODE_LEN) {
+                    l = MIN(FFT_LEN-i, CODE_LEN-j);
+                    ConjMul(p[i], data[i], c+2*j, l);
+                }
+                else {
+                    l = MIN(FFT_LEN-i, FFT_LEN-j);
+                    ConjMulRev(p[i], data[i], c+2*(FFT_LEN-j), l);
+                }
+            }
         }
+        else {
+            // prod[m][u] = conj(data[dop+v]) * code[v], v = u or u-len: only the
+            // len bins centred on the code, rotated down by dop (phase ramp only)
+            for (int u=0, l; u<len; u+=l) {
+                int v = u<len/2? u : u-len;
+                int i = ((dop+v)%FFT_LEN + FFT_LEN) % FFT_LEN;
+                if (v>=0) {
+                    l = MIN(len/2-u, FFT_LEN-i);
+                    ConjMul(p[u], data[i], c+2*v, l);
+                }
+                else {
+                    l = MIN(len-u, FFT_LEN-i);
+                    ConjMulRev(p[u], data[i], c-2*v, l);
+                }
+            }
+        }
+    }
+}
+
+void WORKER::Inverse(int n) {
+    const int len = FFT_LEN/job_dec;
+    fftwf_plan one  = job_dec==1? rev_plan : dec_plan;
+    fftwf_plan many = job_dec==1? rev_many : dec_many;
 
-        fftwf_execute(rev_plan);
-//        NextTask();
+    PERF(PERF_INVERSE);
+    PERF_ITEMS(PERF_INVERSE, n);
+
+    if (n==batch)
+        fftwf_execute_dft(many, prod, prod);
+    else // short batch at top of Doppler range
+        for (int m=0; m<n; m++)
+            fftwf_execute_dft(one, prod+m*len, prod+m*len);
+}
 
-        for (i=0; i<FS/1000; i++) {
-            float pwr = prod[i][0]*prod[i][0] + prod[i][1]*prod[i][1];
+void WORKER::Accumulate(int n, int blk) {
+    const int len = FFT_LEN/job_dec;  // this stage's FFT length ...
+    const int spc = FS/job_dec/1000;  // ... and samples per code period
+
+    // Peak moves blk*BLK_ADV samples later in the code: realign to block 0 as we sum
+    int o = int(fmod(double(blk)*BLK_ADV/job_dec, FS/job_dec/1000) + 0.5) % spc;
+
+    PERF(PERF_POWER);
+    PERF_ITEMS(PERF_POWER, n);
+
+    for (int m=0; m<n; m++) {
+        fftwf_complex *p = prod + m*len + o;
+        float *a = acc + m*spc;
+        int i;
+        if (blk==0) memset(a, 0, sizeof(float) * spc);
+        for (i=0; i<spc-o; i++) a[i] += p[i][0]*p[i][0] + p[i][1]*p[i][1];
+        for (p-=spc; i<spc; i++) a[i] += p[i][0]*p[i][0] + p[i][1]*p[i][1];
+    }
+}
+
+void WORKER::Peak(int k, int b0, int n) { // over each summed surface
+    const int spc = FS/job_dec/1000;
+
+    PERF(PERF_PEAK);
+    PERF_ITEMS(PERF_PEAK, n);
+
+    for (int m=0; m<n; m++) {
+        float *a = acc + m*spc;
+        float max_pwr=0, tot_pwr=0;
+        int i, max_pwr_i=0;
+
+        for (i=0; i<spc; i++) {
+            float pwr = a[i];
             if (pwr>max_pwr) max_pwr=pwr, max_pwr_i=i;
             tot_pwr += pwr;
         }
 
         float ave_pwr = tot_pwr/i;
-        float snr = max_pwr/ave_pwr;
-        if (snr>max_snr) max_snr=snr, *max_snr_dop=dop, *max_snr_i=max_pwr_i;
+        BIN *res = job_res + k*job_bins + b0+m;
+        res->snr  = max_pwr/ave_pwr;
+        res->i    = max_pwr_i;
+        res->frac = Vertex(a[(max_pwr_i+spc-1)%spc], max_pwr, a[(max_pwr_i+1)%spc]);
     }
-    return max_snr;
+}
+
+void WORKER::Correlate(int item) {
+    int k  = item/job_blks;
+    int b0 = item%job_blks * batch;
+    int n  = MIN(batch, job_bins-b0);
+
+    for (int blk=0; blk<noncoh; blk++) {
+        Products(k, b0, n, fwd_buf + blk*FFT_LEN);
+        Inverse(n);
+        Accumulate(n, blk);
+    }
+    Peak(k, b0, n);
 }
 
 ///////////////////////////////////////////////////////////////////////////////////////////////
+// Work stealing: owner pops from the head of its queue, thieves take half from the tail
+
+int WORKER::Pop() {
+    int item=-1;
+    pthread_mutex_lock(&lock);
+    if (head<tail) item = head++;
+    pthread_mutex_unlock(&lock);
+    return item;
+}
+
+int WORKER::Steal(int n) {
+    int lo=-1, hi;
+    for (int k=1; k<NumWorkers && lo<0; k++) {
+        WORKER *v = Workers + (n+k)%NumWorkers;
+        pthread_mutex_lock(&v->lock);
+        if (v->head<v->tail) {
+            hi = v->tail;
+            lo = v->tail -= (hi-v->head+1)/2;
+        }
+        pthread_mutex_unlock(&v->lock);
+    }
+    if (lo<0) return -1; // nothing left anywhere
 
-int SearchCode(int sv, int g1) { // Could do this with look-up tables
-    int chips=0;
-    for (CACODE ca(Sats[sv].T1, Sats[sv].T2); ca.GetG1()!=(unsigned int)g1; ca.Clock()) chips++;
-    return chips;
+    pthread_mutex_lock(&lock);
+    head = lo+1;
+    tail = hi;
+    pthread_mutex_unlock(&lock);
+    return lo;
+}
+
+void WORKER::Work() {
+    int n = this-Workers;
+    for (;;) {
+        int item = Pop();
+        if (item<0) item = Steal(n);
+        if (item<0) break;
+        Correlate(item);
+    }
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////
+
+double Seconds() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec*1e-9;
+}
+
+static double t_coarse, t_fine; // Stage timings, summed over a sweep
+
+static double ref_dop[CA_PRNS];  // Peak interpolated between Doppler bins, bins
+static double ref_i[CA_PRNS];    // ... and between samples of the final stage
+
+// Run one stage: job_bins bins from job_dop[k] for each SV, at decimation job_dec
+static void Stage(int nsv, const int *svs, float *snr, int *max_snr_dop, int *max_snr_i) {
+
+    job_blks = (job_bins+batch-1)/batch;
+    memcpy(job_sv, svs, nsv*sizeof(int));
+
+    // Contiguous share of the items per worker, so neighbours reuse the same code spectrum
+    int items = nsv*job_blks;
+    for (int n=0; n<NumWorkers; n++) {
+        Workers[n].head = items* n   /NumWorkers;
+        Workers[n].tail = items*(n+1)/NumWorkers;
+    }
+
+    pthread_barrier_wait(&job_start);
+    Workers[0].Work();
+    pthread_barrier_wait(&job_done);
+
+    // Reduce in Doppler order: same winner as a serial sweep
+    for (int k=0; k<nsv; k++) {
+        int sv = svs[k], m=0;
+        BIN *res = job_res + k*job_bins;
+        snr[sv]=0;
+        for (int b=0; b<job_bins; b++)
+            if (res[b].snr>snr[sv]) snr[sv]=res[b].snr, max_snr_dop[sv]=job_dop[k]+b, max_snr_i[sv]=res[b].i, m=b;
+
+        ref_dop[sv] = max_snr_dop[sv];
+        if (m>0 && m<job_bins-1) ref_dop[sv] += Vertex(res[m-1].snr, res[m].snr, res[m+1].snr);
+        ref_i[sv] = max_snr_i[sv] + res[m].frac;
+    }
+}
+
+// Bins centre[sv]-half ... centre[sv]+half of each SV, or the whole range if centre is NULL;
+// decimated, then full rate around the peak, if two-stage
+static void Window(int nsv, const int *svs, const int *centre, int half, float *snr, int *max_snr_dop, int *max_snr_i) {
+
+    const int max_bin = int(max_fo*FFT_LEN/FS);
+
+    for (int k=0; k<nsv; k++) job_dop[k] = -max_bin;
+    job_bins = 2*max_bin + 1;
+    job_dec  = DEC;
+
+    if (centre) {
+        job_bins = MIN(2*half+1, job_bins);
+        for (int k=0; k<nsv; k++)
+            job_dop[k] = MAX(-max_bin, MIN(max_bin-job_bins+1, centre[svs[k]]-half));
+    }
+
+    double t0 = Seconds();
+    Stage(nsv, svs, snr, max_snr_dop, max_snr_i);
+    double t1 = Seconds();
+
+    if (DEC==1) return;
+    t_coarse += t1-t0;
+
+    // Full rate around the coarse peak of each SV
+    for (int k=0; k<nsv; k++)
+        job_dop[k] = MAX(-max_bin, MIN(max_bin-FINE_BINS+1, max_snr_dop[svs[k]]-FINE_BINS/2));
+    job_bins = MIN(FINE_BINS, 2*max_bin+1);
+    job_dec  = 1;
+
+    Stage(nsv, svs, snr, max_snr_dop, max_snr_i);
+    t_fine += Seconds()-t1;
+}
+
+// Search SVs captured at Unix time t: warm ones first around their last Doppler, then the
+// rest and any misses over the whole range, or the predicted window if assisted
+void Correlate(int nsv, const int *svs, double t, float *snr, int *max_snr_dop, int *max_snr_i) {
+
+    const int max_bin = int(max_fo*FFT_LEN/FS);
+    int hot[CA_PRNS], cold[CA_PRNS], centre[CA_PRNS];
+    int nhot=0, ncold=0, half=0;
+
+    for (int k=0; k<nsv; k++) CodeSpectrum(svs[k]);
+
+    for (int k=0; k<nsv; k++) {
+        int sv=svs[k], h=0;
+        const WARM &w = warm[Cat[sv]];
+        if (warm_file && w.snr>0 && (h=WarmHalf(Cat[sv], t))<max_bin) {
+            centre[sv] = int(floor(w.hz*FFT_LEN/FS + 0.5));
+            half = MAX(half, h);
+            hot[nhot++] = sv;
+        }
+        else
+            cold[ncold++] = sv;
+    }
+
+    if (nhot) {
+        Window(nhot, hot, centre, half, snr, max_snr_dop, max_snr_i);
+        warm_tries += nhot;
+        for (int k=0; k<nhot; k++)
+            if (snr[hot[k]]<SNR_HIT) cold[ncold++] = hot[k];
+            else warm_hits++;
+    }
+    if (ncold) Window(ncold, cold, aid_t0>=0? aid_bin : NULL, aid_half, snr, max_snr_dop, max_snr_i);
+
+    if (warm_file)
+        for (int k=0; k<nsv; k++) {
+            int sv = svs[k];
+            WARM &w = warm[Cat[sv]];
+            w.snr   = snr[sv]<SNR_HIT? 0 : snr[sv];
+            w.hz    = ref_dop[sv]*FS/FFT_LEN;
+            w.chips = ref_i[sv]*CPS/FS;
+            w.t     = t;
+        }
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////
+
+int SearchCode(int /*sv*/, int g1) { // G1 is common to all SVs: sv is not needed
+    return CaTable.g1_chip[g1 & 0x3FF];
 }
 
 ///////////////////////////////////////////////////////////////////////////////////////////////
 
 void SearchEnable(int sv) {
     Busy[sv] = false;
+    Lost[sv] = true;
 }
 
 ///////////////////////////////////////////////////////////////////////////////////////////////
@@ -219,33 +962,70 @@ void SearchEnable(int sv) {
 void SearchTask(char *filename_1bit_bin) {
     int sv, lo_shift, ca_shift;
     float snr;
-    FILE *fp;
+    double t_sample=0;
+    SOURCE src;
+
+    int   all_sv[CA_PRNS], vis_sv[CA_PRNS];
+    float snr_res[CA_PRNS];
+    int   lo_res[CA_PRNS], ca_res[CA_PRNS];
 
-    fp = fopen(filename_1bit_bin, "rb");
-    if (fp == NULL) {
+    for (sv=0; sv<NumSats; sv++) all_sv[sv]=sv;
+
+    if (src.Open(filename_1bit_bin, Formats[format].bits)) {
       printf("can not open file!\n");
       return;
     }
+    if (src.SeekTime(start_time)) {
+      printf("%.3f s is beyond end of file!\n", start_time);
+      src.Close();
+      return;
+    }
+    if (duration>0) src.SetEnd(start_time+duration);
+    warm_t0 = CaptureTime(src, filename_1bit_bin);
     int run_out = 0;
     int run_count = 0;
-    float sat_snr_store[NUM_SATS];
-    float snr_store[NUM_SATS];
-    int   sv_store[NUM_SATS];
-    int   lo_store[NUM_SATS];
-    int   ca_store[NUM_SATS];
+    float sat_snr_store[CA_PRNS];
+    float snr_store[CA_PRNS];
+    int   sv_store[CA_PRNS];
+    int   lo_store[CA_PRNS];
+    int   ca_store[CA_PRNS];
     int hit_count, i;
     for(;;) {
         hit_count = 0;
-        for (sv=0; sv<NUM_SATS; sv++) {
-            run_out = Sample(fp);
-            if (run_out) {
-              printf("run out of file!\n");
+        t_coarse = t_fine = 0;
+        warm_tries = warm_hits = 0;
+
+        int nsv = NumSats, *svs = all_sv;
+        if (aid_t0>=0) {
+            nsv = Visible(src.Time(), svs = vis_sv);
+            if (nsv==0) {
+              printf("no SVs above %.0f deg!\n", aid_mask);
               break;
             }
+            for (sv=0; sv<NumSats; sv++) sat_snr_store[sv] = 0;
+        }
+
+        for (int k=0; k<nsv; k++) {
+            sv = svs[k];
+            if (k==0 || !snapshot) { // one capture per sweep, or one per SV
+                t_sample = src.Time(); // seconds into file
+                run_out = Capture(src);
+                if (run_out) {
+                  printf("run out of file!\n");
+                  break;
+                }
+                double t = warm_t0 + t_sample-start_time;
+                if (snapshot)
+                    Correlate(nsv, svs, t, snr_res, lo_res, ca_res);
+                else
+                    Correlate(1, &sv, t, snr_res, lo_res, ca_res);
+            }
 
-            snr = Correlate(sv, &lo_shift, &ca_shift);
+            snr = snr_res[sv];
+            lo_shift = lo_res[sv];
+            ca_shift = ca_res[sv];
             sat_snr_store[sv] = snr;
-            if (snr<25) {
+            if (snr<SNR_HIT) {
                 continue;
             }
             else {
@@ -261,11 +1041,24 @@ void SearchTask(char *filename_1bit_bin) {
           break;
         }
 
+        if (snapshot) printf("%2d  t_sample: %.6f s\n", run_count, t_sample);
+        if (aid_t0>=0) printf("%2d  assisted: %d SVs above %.0f deg\n", run_count, nsv, aid_mask);
+        if (warm_tries) printf("%2d      warm: %d of %d SVs found near last Doppler\n", run_count, warm_hits, warm_tries);
+        if (DEC>1)    printf("%2d    search: coarse %.3f s, fine %.3f s\n", run_count, t_coarse, t_fine);
+        if (src.stream) printf("%2d    stream: %" PRIu64 " overruns, %.0f samples dropped\n", run_count,
+                               __atomic_load_n(&src.overruns, __ATOMIC_RELAXED), src.Dropped());
         printf("%2d satellite: ", run_count);
         for (i=0; i<hit_count; i++) {
           printf("%5d ", sv_store[i]);
         }
         printf("\n");
+        if (prns) {
+          printf("%2d       PRN: ", run_count);
+          for (i=0; i<hit_count; i++) {
+            printf("%5d ", CaSignals[Cat[sv_store[i]]].prn);
+          }
+          printf("\n");
+        }
         printf("%2d SNR(>=25): ", run_count);
         for (i=0; i<hit_count; i++) {
           printf("%5.1f ", snr_store[i]);
@@ -281,12 +1074,131 @@ void SearchTask(char *filename_1bit_bin) {
           printf("%5d ", ca_store[i]);
         }
         printf("\n");
-        for (sv=0; sv<NUM_SATS; sv++) {
+        printf("%2d    dop_hz: ", run_count);
+        for (i=0; i<hit_count; i++) {
+          printf("%5.0f ", ref_dop[sv_store[i]]*FS/FFT_LEN);
+        }
+        printf("\n");
+        printf("%2d   ca_chip: ", run_count);
+        for (i=0; i<hit_count; i++) {
+          printf("%5.1f ", ref_i[sv_store[i]]*CPS/FS);
+        }
+        printf("\n");
+        for (sv=0; sv<NumSats; sv++) {
           printf("%2.0f ", sat_snr_store[sv]);
         }
         printf("\n\n");
         run_count++;
 
+        if (warm_file) WarmSave();
+
     }
-    fclose(fp);
+    src.Close();
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////
+// Receiver: software channels track what the search finds, block by block along the capture,
+// with a fix every few seconds.  Only GPS PRNs are handed to channels: SBAS carries no
+// ephemeris for the solution.
+
+void ReceiveTask(char *filename) {
+    const double ACQ_EVERY = 10;    // Seconds of capture between searches for free channels
+    const double LOST_WAIT = 0.1;   // ... and from a channel losing its PRN to searching for it
+    const double FIX_EVERY = 4;     // ... and between fixes
+    const int BLK = (int(FS/1000)+7)/8*8; // ~1 ms, whole bytes of 1-bit samples
+
+    int   cand[CA_PRNS], vis_sv[CA_PRNS];
+    float snr_res[CA_PRNS];
+    int   lo_res[CA_PRNS], ca_res[CA_PRNS];
+    SOURCE src;
+
+    if (src.Open(filename, Formats[format].bits)) {
+      printf("can not open file!\n");
+      return;
+    }
+    if (src.SeekTime(start_time)) {
+      printf("%.3f s is beyond end of file!\n", start_time);
+      src.Close();
+      return;
+    }
+    if (duration>0) src.SetEnd(start_time+duration);
+    warm_t0 = CaptureTime(src, filename);
+
+    int nt = ChanInit(BLK);
+    if (nt<0) {
+      printf("ChanInit() returned %d\n", nt);
+      src.Close();
+      return;
+    }
+    printf("%d tracker thread%s\n", nt, nt>1? "s":"");
+
+    const size_t bytes = size_t(BLK)*Formats[format].bits/8;
+    double t_acq = src.Time(), t_fix = src.Time()+FIX_EVERY, t_lost = -1;
+    memset(Lost, 0, sizeof Lost);
+
+    for (;;) {
+        double t = src.Time();
+
+        // All PRNs every ACQ_EVERY; those dropped, LOST_WAIT after the first of them
+        if (ChanLost() && t_lost<0) t_lost = t;
+        bool cold = t>=t_acq, lost = t_lost>=0 && t>=t_lost+LOST_WAIT;
+
+        if (cold || lost) {
+            if (cold) t_acq = t+ACQ_EVERY;
+            t_lost = -1;
+            ChanSync();
+
+            // Free channels, and GPS SVs not already on one
+            bool free = ChanReset()>=0;
+            int nsv=0;
+            if (aid_t0>=0) {
+                int n = Visible(t, vis_sv);
+                for (int k=0; k<n; k++) cand[nsv++] = vis_sv[k];
+            }
+            else
+                for (int sv=0; sv<NumSats; sv++) cand[nsv++] = sv;
+
+            int n=0;
+            for (int k=0; k<nsv; k++)
+                if (CaSignals[Cat[cand[k]]].prn<=NUM_SATS && !Busy[Cat[cand[k]]] && (cold || Lost[Cat[cand[k]]]))
+                    cand[n++] = cand[k];
+            nsv = n;
+            memset(Lost, 0, sizeof Lost);
+
+            if (free && nsv) {
+                // Search, then rewind over the capture so channels see every sample and
+                // start where the search measured them.  The mark holds it in a stream ring.
+                src.Mark();
+                if (Capture(src)) break;
+                src.Rewind();
+
+                Correlate(nsv, cand, warm_t0+t-start_time, snr_res, lo_res, ca_res);
+                if (warm_file) WarmSave();
+
+                for (int k=0; k<nsv; k++) {
+                    int sv = cand[k], ch;
+                    if (snr_res[sv]<SNR_HIT || (ch=ChanReset())<0) continue;
+                    Busy[Cat[sv]] = true;
+                    ChanStart(ch, Cat[sv], ref_dop[sv], ref_i[sv]);
+                }
+            }
+        }
+
+        const unsigned char *rx;
+        {
+            PERF(PERF_READ);
+            rx = src.View(bytes, bytes);
+        }
+        if (!rx) break;
+        ChanSamples(rx, BLK);
+
+        if (src.Time()>=t_fix) {
+            t_fix += FIX_EVERY;
+            SolveEpoch(src.Time()-start_time);
+        }
+    }
+
+    ChanFree();
+    printf("end of capture at %.3f s\n", src.Time());
+    src.Close();
 }
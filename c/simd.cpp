@@ -0,0 +1,335 @@
+///////////////////////////////////////////////////////////////////////////////////////////////
+// Homemade GPS Receiver
+// Copyright (c) Andrew Holme 2011-2013
+// http://www.holmea.demon.co.uk/GPS/Main.htm
+///////////////////////////////////////////////////////////////////////////////////////////////
+
+#include <memory.h>
+#include <stdlib.h>
+
+#include "simd.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define SIMD_X86
+#endif
+
+///////////////////////////////////////////////////////////////////////////////////////////////
+// Reference kernels.  Vector versions must match these bit-for-bit, so build with
+// -ffp-contract=off: a fused multiply-add rounds differently.
+
+// (a-ib)(x+iy) = (ax+by) + i(ay-bx)
+static void ConjMulScalar(float *out, const float *a, const float *b, int n) {
+    for (int i=0; i<n; i++, out+=2, a+=2, b+=2) {
+        float re = a[0]*b[0] + a[1]*b[1];
+        float im = a[0]*b[1] - a[1]*b[0];
+        out[0] = re;
+        out[1] = im;
+    }
+}
+
+// (a-ib)(x-iy) = (ax-by) - i(ay+bx)
+static void ConjMulRevScalar(float *out, const float *a, const float *b, int n) {
+    for (int i=0; i<n; i++, out+=2, a+=2, b-=2) {
+        float re =   a[0]*b[0] - a[1]*b[1];
+        float im = -(a[0]*b[1] + a[1]*b[0]);
+        out[0] = re;
+        out[1] = im;
+    }
+}
+
+static void WidenScalar(float *out, const signed char *in, int n) {
+    for (int i=0; i<n; i++) out[i] = in[i];
+}
+
+#define BIT_CORR(POPCOUNT)                                      \
+    for (int j=0; j<6; j++) pop[j]=0;                           \
+    for (int i=0; i<n; i++) {                                   \
+        uint64_t ai = x[i] ^ rep[i], aq = x[i] ^ rep[n+i];      \
+        for (int j=0; j<3; j++) {                               \
+            uint64_t c = rep[(2+j)*n+i];                        \
+            pop[2*j+0] += POPCOUNT(ai ^ c);                     \
+            pop[2*j+1] += POPCOUNT(aq ^ c);                     \
+        }                                                       \
+    }
+
+static void BitCorrScalar(int *pop, const uint64_t *x, const uint64_t *rep, int n) {
+    BIT_CORR(__builtin_popcountll)
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////
+// Same sequence at every width; shuffles work within 128-bit lanes (2 complex):
+//   ab = [ax by ...]  ba = [ay bx ...]
+//   even = [ax ax' ay ay']  odd = [by by' bx bx']
+//   ConjMul:    even+odd = [re re' . .]  even-odd = [. . im im']
+//   ConjMulRev: even-odd = [re re' . .]  -(even+odd) = [. . im im']
+// REV reverses the order of complex elements across the whole vector.
+
+#ifdef SIMD_X86
+
+#define CONJ_MUL(MUL, ADD, SUB, SHUF, VA, VB, VO)                  \
+    {                                                           \
+        auto ab   = MUL(VA, VB);                                \
+        auto ba   = MUL(VA, SHUF(VB, VB, 0xB1));                \
+        auto even = SHUF(ab, ba, 0x88);                         \
+        auto odd  = SHUF(ab, ba, 0xDD);                         \
+        auto res  = SHUF(ADD(even, odd), SUB(even, odd), 0xE4); \
+        VO = SHUF(res, res, 0xD8);                              \
+    }
+
+#define CONJ_MUL_REV(MUL, ADD, SUB, XOR, SHUF, NEG, VA, VB, VO)    \
+    {                                                           \
+        auto ab   = MUL(VA, VB);                                \
+        auto ba   = MUL(VA, SHUF(VB, VB, 0xB1));                \
+        auto even = SHUF(ab, ba, 0x88);                         \
+        auto odd  = SHUF(ab, ba, 0xDD);                         \
+        auto res  = SHUF(SUB(even, odd), XOR(ADD(even, odd), NEG), 0xE4); \
+        VO = SHUF(res, res, 0xD8);                              \
+    }
+
+static void ConjMulSSE2(float *out, const float *a, const float *b, int n) {
+    int i=0;
+    for (; i+2<=n; i+=2) {
+        __m128 o;
+        CONJ_MUL(_mm_mul_ps, _mm_add_ps, _mm_sub_ps, _mm_shuffle_ps,
+                 _mm_loadu_ps(a+2*i), _mm_loadu_ps(b+2*i), o)
+        _mm_storeu_ps(out+2*i, o);
+    }
+    ConjMulScalar(out+2*i, a+2*i, b+2*i, n-i);
+}
+
+static void ConjMulRevSSE2(float *out, const float *a, const float *b, int n) {
+    const __m128 neg = _mm_set1_ps(-0.0f);
+    int i=0;
+    for (; i+2<=n; i+=2) {
+        __m128 o, r = _mm_loadu_ps(b-2*(i+1));
+        r = _mm_shuffle_ps(r, r, 0x4E);
+        CONJ_MUL_REV(_mm_mul_ps, _mm_add_ps, _mm_sub_ps, _mm_xor_ps, _mm_shuffle_ps, neg,
+                     _mm_loadu_ps(a+2*i), r, o)
+        _mm_storeu_ps(out+2*i, o);
+    }
+    ConjMulRevScalar(out+2*i, a+2*i, b-2*i, n-i);
+}
+
+static void WidenSSE2(float *out, const signed char *in, int n) {
+    int i=0;
+    for (; i+16<=n; i+=16) {
+        __m128i b = _mm_loadu_si128((const __m128i *) (in+i));
+        __m128i lo = _mm_srai_epi16(_mm_unpacklo_epi8(b, b), 8); // sign-extend to 16 bits
+        __m128i hi = _mm_srai_epi16(_mm_unpackhi_epi8(b, b), 8);
+        _mm_storeu_ps(out+i+ 0, _mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpacklo_epi16(lo, lo), 16)));
+        _mm_storeu_ps(out+i+ 4, _mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpackhi_epi16(lo, lo), 16)));
+        _mm_storeu_ps(out+i+ 8, _mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpacklo_epi16(hi, hi), 16)));
+        _mm_storeu_ps(out+i+12, _mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpackhi_epi16(hi, hi), 16)));
+    }
+    WidenScalar(out+i, in+i, n-i);
+}
+
+__attribute__((target("avx2")))
+static void ConjMulAVX2(float *out, const float *a, const float *b, int n) {
+    int i=0;
+    for (; i+4<=n; i+=4) {
+        __m256 o;
+        CONJ_MUL(_mm256_mul_ps, _mm256_add_ps, _mm256_sub_ps, _mm256_shuffle_ps,
+                 _mm256_loadu_ps(a+2*i), _mm256_loadu_ps(b+2*i), o)
+        _mm256_storeu_ps(out+2*i, o);
+    }
+    ConjMulScalar(out+2*i, a+2*i, b+2*i, n-i);
+}
+
+__attribute__((target("avx2")))
+static void ConjMulRevAVX2(float *out, const float *a, const float *b, int n) {
+    const __m256 neg = _mm256_set1_ps(-0.0f);
+    int i=0;
+    for (; i+4<=n; i+=4) {
+        __m256 o, r = _mm256_loadu_ps(b-2*(i+3));
+        r = _mm256_permute2f128_ps(r, r, 0x01);
+        r = _mm256_shuffle_ps(r, r, 0x4E);
+        CONJ_MUL_REV(_mm256_mul_ps, _mm256_add_ps, _mm256_sub_ps, _mm256_xor_ps, _mm256_shuffle_ps, neg,
+                     _mm256_loadu_ps(a+2*i), r, o)
+        _mm256_storeu_ps(out+2*i, o);
+    }
+    ConjMulRevScalar(out+2*i, a+2*i, b-2*i, n-i);
+}
+
+__attribute__((target("avx2")))
+static void WidenAVX2(float *out, const signed char *in, int n) {
+    int i=0;
+    for (; i+16<=n; i+=16) {
+        __m128i b = _mm_loadu_si128((const __m128i *) (in+i));
+        _mm256_storeu_ps(out+i+0, _mm256_cvtepi32_ps(_mm256_cvtepi8_epi32(b)));
+        _mm256_storeu_ps(out+i+8, _mm256_cvtepi32_ps(_mm256_cvtepi8_epi32(_mm_srli_si128(b, 8))));
+    }
+    WidenScalar(out+i, in+i, n-i);
+}
+
+__attribute__((target("avx512f")))
+static void ConjMulAVX512(float *out, const float *a, const float *b, int n) {
+    int i=0;
+    for (; i+8<=n; i+=8) {
+        __m512 o;
+        CONJ_MUL(_mm512_mul_ps, _mm512_add_ps, _mm512_sub_ps, _mm512_shuffle_ps,
+                 _mm512_loadu_ps(a+2*i), _mm512_loadu_ps(b+2*i), o)
+        _mm512_storeu_ps(out+2*i, o);
+    }
+    ConjMulScalar(out+2*i, a+2*i, b+2*i, n-i);
+}
+
+__attribute__((target("avx512f")))
+static __m512 Xor512(__m512 a, __m512 b) { // _mm512_xor_ps needs AVX512DQ
+    return _mm512_castsi512_ps(_mm512_xor_si512(_mm512_castps_si512(a), _mm512_castps_si512(b)));
+}
+
+__attribute__((target("avx512f")))
+static void ConjMulRevAVX512(float *out, const float *a, const float *b, int n) {
+    const __m512 neg = _mm512_set1_ps(-0.0f);
+    int i=0;
+    for (; i+8<=n; i+=8) {
+        __m512 o, r = _mm512_loadu_ps(b-2*(i+7));
+        r = _mm512_mask_shuffle_f32x4(r, 0xFFFF, r, r, 0x1B); // unmasked form trips -Wmaybe-uninitialized
+        r = _mm512_shuffle_ps(r, r, 0x4E);
+        CONJ_MUL_REV(_mm512_mul_ps, _mm512_add_ps, _mm512_sub_ps, Xor512, _mm512_shuffle_ps, neg,
+                     _mm512_loadu_ps(a+2*i), r, o)
+        _mm512_storeu_ps(out+2*i, o);
+    }
+    ConjMulRevScalar(out+2*i, a+2*i, b-2*i, n-i);
+}
+
+__attribute__((target("avx512f")))
+static void WidenAVX512(float *out, const signed char *in, int n) {
+    int i=0;
+    for (; i+16<=n; i+=16) { // maskz forms: unmasked ones trip -Wmaybe-uninitialized
+        __m512i d = _mm512_maskz_cvtepi8_epi32(0xFFFF, _mm_loadu_si128((const __m128i *) (in+i)));
+        _mm512_storeu_ps(out+i, _mm512_maskz_cvtepi32_ps(0xFFFF, d));
+    }
+    WidenScalar(out+i, in+i, n-i);
+}
+
+// Bit correlator: the scalar loop with the POPCNT instruction, or 8 words at a time
+// with AVX-512 VPOPCNTDQ
+
+__attribute__((target("popcnt")))
+static void BitCorrPopcnt(int *pop, const uint64_t *x, const uint64_t *rep, int n) {
+    BIT_CORR(_mm_popcnt_u64)
+}
+
+__attribute__((target("avx512f,avx512vpopcntdq")))
+static void BitCorrAVX512(int *pop, const uint64_t *x, const uint64_t *rep, int n) {
+    __m512i sum[6];
+    for (int j=0; j<6; j++) sum[j] = _mm512_setzero_si512();
+
+    for (int i=0; i<n; i+=8) {
+        __mmask8 m = n-i>=8? 0xFF : (1<<(n-i))-1; // zeros past the end count nothing
+        __m512i v  = _mm512_maskz_loadu_epi64(m, x+i);
+        __m512i ai = _mm512_xor_si512(v, _mm512_maskz_loadu_epi64(m, rep+i));
+        __m512i aq = _mm512_xor_si512(v, _mm512_maskz_loadu_epi64(m, rep+n+i));
+        for (int j=0; j<3; j++) {
+            __m512i c = _mm512_maskz_loadu_epi64(m, rep+(2+j)*n+i);
+            sum[2*j+0] = _mm512_add_epi64(sum[2*j+0], _mm512_popcnt_epi64(_mm512_xor_si512(ai, c)));
+            sum[2*j+1] = _mm512_add_epi64(sum[2*j+1], _mm512_popcnt_epi64(_mm512_xor_si512(aq, c)));
+        }
+    }
+
+    for (int j=0; j<6; j++) { // _mm512_reduce_add_epi64 trips -Wuninitialized
+        uint64_t t[8];
+        _mm512_storeu_si512(t, sum[j]);
+        pop[j] = int(t[0]+t[1]+t[2]+t[3]+t[4]+t[5]+t[6]+t[7]);
+    }
+}
+
+#endif
+
+///////////////////////////////////////////////////////////////////////////////////////////////
+
+typedef void BIT_CORR_KERNEL(int *, const uint64_t *, const uint64_t *, int);
+
+BIT_CORR_KERNEL *BitCorr = BitCorrScalar;
+
+static bool BitExact(BIT_CORR_KERNEL *bit_corr) {
+    const int N=37;
+    static uint64_t x[N], rep[5*N];
+    int ref[6], out[6];
+
+    srand(1);
+    for (int i=0; i<N; i++) x[i] = uint64_t(rand())<<40 ^ uint64_t(rand())<<20 ^ rand();
+    for (int i=0; i<5*N; i++) rep[i] = uint64_t(rand())<<40 ^ uint64_t(rand())<<20 ^ rand();
+
+    BitCorrScalar(ref, x, rep, N);
+    bit_corr(out, x, rep, N);
+    return 0==memcmp(ref, out, sizeof ref);
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////
+
+typedef void KERNEL(float *, const float *, const float *, int);
+typedef void WIDEN(float *, const signed char *, int);
+
+KERNEL *ConjMul    = ConjMulScalar;
+KERNEL *ConjMulRev = ConjMulRevScalar;
+WIDEN  *Widen      = WidenScalar;
+
+///////////////////////////////////////////////////////////////////////////////////////////////
+// Check candidates against the scalar kernels on random data, odd length to cover the tail
+
+static bool BitExact(KERNEL *conj_mul, KERNEL *conj_mul_rev, WIDEN *widen) {
+    const int N=1001;
+    static float a[2*N], b[2*N], ref[2*N], out[2*N];
+    static signed char c[2*N];
+
+    srand(1);
+    for (int i=0; i<2*N; i++) {
+        a[i] = rand()*2.0f/RAND_MAX - 1;
+        b[i] = rand()*2e3f/RAND_MAX - 1e3f;
+        c[i] = rand();
+    }
+
+    WidenScalar(ref, c, 2*N);
+    widen(out, c, 2*N);
+    if (memcmp(ref, out, sizeof ref)) return false;
+
+    ConjMulScalar(ref, a, b, N);
+    conj_mul(out, a, b, N);
+    if (memcmp(ref, out, sizeof ref)) return false;
+
+    ConjMulRevScalar(ref, a, b+2*(N-1), N);
+    conj_mul_rev(out, a, b+2*(N-1), N);
+    return 0==memcmp(ref, out, sizeof ref);
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////
+
+const char *SimdInit() {
+
+#ifdef SIMD_X86
+    __builtin_cpu_init();
+
+    if (__builtin_cpu_supports("avx512vpopcntdq") && BitExact(BitCorrAVX512))
+        BitCorr = BitCorrAVX512;
+    else if (__builtin_cpu_supports("popcnt") && BitExact(BitCorrPopcnt))
+        BitCorr = BitCorrPopcnt;
+
+    struct {
+        const char *name;
+        int supported;
+        KERNEL *conj_mul, *conj_mul_rev;
+        WIDEN *widen;
+    } sets[] = {
+        {"avx512", __builtin_cpu_supports("avx512f"), ConjMulAVX512, ConjMulRevAVX512, WidenAVX512},
+        {"avx2",   __builtin_cpu_supports("avx2"),    ConjMulAVX2,   ConjMulRevAVX2,   WidenAVX2},
+        {"sse2",   __builtin_cpu_supports("sse2"),    ConjMulSSE2,   ConjMulRevSSE2,   WidenSSE2}
+    };
+
+    for (auto &set : sets)
+        if (set.supported && BitExact(set.conj_mul, set.conj_mul_rev, set.widen)) {
+            ConjMul    = set.conj_mul;
+            ConjMulRev = set.conj_mul_rev;
+            Widen      = set.widen;
+            return set.name;
+        }
+#endif
+
+    ConjMul    = ConjMulScalar;
+    ConjMulRev = ConjMulRevScalar;
+    Widen      = WidenScalar;
+    return "scalar";
+}
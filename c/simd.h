@@ -0,0 +1,25 @@
+///////////////////////////////////////////////////////////////////////////////////////////////
+// Homemade GPS Receiver
+// Copyright (c) Andrew Holme 2011-2013
+// http://www.holmea.demon.co.uk/GPS/Main.htm
+///////////////////////////////////////////////////////////////////////////////////////////////
+
+#include <stdint.h>
+
+///////////////////////////////////////////////////////////////////////////////////////////////
+// Vector kernels, selected at run time by SimdInit()
+
+// out[i] = conj(a[i]) * b[i] on interleaved complex floats; out may alias a
+extern void (*ConjMul)(float *out, const float *a, const float *b, int n);
+
+// out[i] = conj(a[i]) * conj(b[-i]): b read backwards, e.g. mirrored half of a Hermitian spectrum
+extern void (*ConjMulRev)(float *out, const float *a, const float *b, int n);
+
+// out[i] = in[i]: sign-extend and convert, e.g. unpacked +/-1 samples
+extern void (*Widen)(float *out, const signed char *in, int n);
+
+// Bit-packed correlation, 1 = negative: pop[2*j+k] = sum of popcount(x[i] ^ lo[k][i] ^ code[j][i])
+// where rep holds rows lo[0...1] (carrier I, Q) then code[0...2] (early, prompt, late), n apart
+extern void (*BitCorr)(int *pop, const uint64_t *x, const uint64_t *rep, int n);
+
+const char *SimdInit(); // returns name of the kernel set in use
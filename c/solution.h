@@ -0,0 +1,23 @@
+///////////////////////////////////////////////////////////////////////////////////////////////
+// Homemade GPS Receiver
+// Copyright (c) Andrew Holme 2011-2013
+// http://www.holmea.demon.co.uk/GPS/Main.htm
+///////////////////////////////////////////////////////////////////////////////////////////////
+
+#include <stdint.h>
+
+#define MAX_ITER 20
+
+///////////////////////////////////////////////////////////////////////////////////////////////
+// Navigation solution from a set of clock replicas.  Include ephemeris.h first.
+
+struct SNAPSHOT {
+    EPHEM eph;
+    float power;
+    int ch, sv, ms, bits, g1, ca_phase;
+    bool LoadAtomic(int ch, uint16_t *up, uint16_t *dn);
+    double GetClock();
+};
+
+int  Solve(SNAPSHOT *Replicas, int chans, double *x_n, double *y_n, double *z_n, double *t_bias); // returns iterations, MAX_ITER = no fix
+void LatLonAlt(double x_n, double y_n, double z_n, double& lat, double& lon, double& alt);
@@ -0,0 +1,57 @@
+///////////////////////////////////////////////////////////////////////////////////////////////
+// Homemade GPS Receiver
+// Copyright (c) Andrew Holme 2011-2013
+// http://www.holmea.demon.co.uk/GPS/Main.htm
+///////////////////////////////////////////////////////////////////////////////////////////////
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+
+#include "gps_offline.h"
+#include "ephemeris.h"
+#include "solution.h"
+
+///////////////////////////////////////////////////////////////////////////////////////////////
+
+static SNAPSHOT *Replicas;          // One per channel
+static int Size;
+
+///////////////////////////////////////////////////////////////////////////////////////////////
+// Software channels stop between blocks, so once the trackers are synced one pass is a
+// consistent snapshot: no atomic section or glitch guard as solve.cpp needs for the FPGA.
+
+static int LoadReplicas() {
+    int chans=0;
+
+    ChanSync();
+
+    if (Size<channels) {
+        SNAPSHOT *p = (SNAPSHOT *) realloc(Replicas, channels*sizeof(SNAPSHOT));
+        if (!p) return 0;
+        Replicas = p;
+        Size = channels;
+    }
+
+    for (int ch=0; ch<channels; ch++)
+        if (ChanSnapshot(ch, Replicas+chans)) chans++;
+
+    return chans;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////
+
+void SolveEpoch(double t) {
+    double x, y, z, t_b, lat, lon, alt;
+
+    int chans = LoadReplicas();
+    if (chans<4) return;
+    int iter = Solve(Replicas, chans, &x, &y, &z, &t_b);
+    if (iter==MAX_ITER) return;
+    LatLonAlt(x, y, z, lat, lon, alt);
+    printf(
+        "\n%.3f,%d,%3d,%10.6f,"
+        "%10.5f,%10.5f,%8.2f\n\n",
+        t, chans, iter, t_b,
+        lat*180/PI, lon*180/PI, alt);
+}
@@ -0,0 +1,225 @@
+///////////////////////////////////////////////////////////////////////////////////////////////
+// Homemade GPS Receiver
+// Copyright (c) Andrew Holme 2011-2013
+// http://www.holmea.demon.co.uk/GPS/Main.htm
+///////////////////////////////////////////////////////////////////////////////////////////////
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+
+#include "gps_offline.h"
+#include "source.h"
+
+///////////////////////////////////////////////////////////////////////////////////////////////
+
+int SOURCE::Open(const char *filename, int sample_bits) {
+    struct stat st;
+
+    bits = sample_bits;
+    base = NULL;
+    size = pos = end = 0;
+    mark = SIZE_MAX;
+    stream = false;
+
+    if (0==strcmp(filename, "-")) return OpenStream(dup(0));
+
+    if (0==strncmp(filename, "tcp:", 4)) { // tcp:host:port
+        char host[256];
+        const char *port = strrchr(filename, ':');
+        struct addrinfo hints={}, *ai;
+
+        snprintf(host, sizeof host, "%.*s", int(port-filename-4), filename+4);
+        hints.ai_socktype = SOCK_STREAM;
+        if (getaddrinfo(host, port+1, &hints, &ai)) return -4;
+
+        int fd = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+        if (fd>=0 && connect(fd, ai->ai_addr, ai->ai_addrlen)) close(fd), fd=-1;
+        freeaddrinfo(ai);
+        return OpenStream(fd);
+    }
+
+    int fd = open(filename, O_RDONLY);
+    if (fd<0) return -1;
+
+    if (fstat(fd, &st)) {
+        close(fd);
+        return -2;
+    }
+
+    if (!S_ISREG(st.st_mode)) return OpenStream(fd); // FIFO, character device
+
+    void *map = st.st_size? mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0) : MAP_FAILED;
+    close(fd); // mapping holds its own reference
+    if (map==MAP_FAILED) return -3;
+
+    madvise(map, st.st_size, MADV_SEQUENTIAL); // aggressive readahead, drop pages behind us
+
+    base = (const unsigned char *) map;
+    size = end = st.st_size;
+    return 0;
+}
+
+void SOURCE::Close() {
+    if (stream) {
+        pthread_cancel(thread); // may be blocked in read()
+        pthread_join(thread, NULL);
+        close(fd);
+        munmap((void *) base, 2*RING_SIZE);
+    }
+    else if (base) munmap((void *) base, size);
+    base = NULL;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////
+// Stream ring: single producer (reader thread), single consumer (View), no locks.
+// Mapped twice back to back so every view is contiguous, even across the wrap.
+
+static void *ReaderThread(void *param) {
+    ((SOURCE *) param)->Reader();
+    return NULL;
+}
+
+int SOURCE::OpenStream(int stream_fd) {
+    if (stream_fd<0) return -1;
+
+    int mfd = memfd_create("gps_ring", 0);
+    if (mfd<0 || ftruncate(mfd, RING_SIZE)) {
+        close(stream_fd);
+        return -5;
+    }
+
+    unsigned char *ring = (unsigned char *) mmap(NULL, 2*RING_SIZE, PROT_NONE, MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+    if (ring==MAP_FAILED
+     || mmap(ring,           RING_SIZE, PROT_READ|PROT_WRITE, MAP_SHARED|MAP_FIXED, mfd, 0)==MAP_FAILED
+     || mmap(ring+RING_SIZE, RING_SIZE, PROT_READ|PROT_WRITE, MAP_SHARED|MAP_FIXED, mfd, 0)==MAP_FAILED) {
+        close(mfd);
+        close(stream_fd);
+        return -6;
+    }
+    close(mfd);
+
+    fd = stream_fd;
+    base = ring;
+    size = end = SIZE_MAX;
+    wr = rd = overruns = dropped = 0;
+    eof = false;
+    stream = true;
+
+    if (pthread_create(&thread, NULL, ReaderThread, this)) {
+        stream = false;
+        close(fd);
+        munmap(ring, 2*RING_SIZE);
+        return -7;
+    }
+    return 0;
+}
+
+void SOURCE::Reader() {
+    static unsigned char junk[1<<16];
+    unsigned char *ring = (unsigned char *) base;
+    const int frame = bits<8? 1 : bits/8; // Bytes per sample: never drop part of one
+    unsigned char part[8];
+    int npart=0;                          // Part sample left from dropping, for the ring
+    bool full=false;
+
+    for (;;) {
+        uint64_t space = RING_SIZE - (wr - __atomic_load_n(&rd, __ATOMIC_ACQUIRE));
+        ssize_t n;
+
+        if (space && !npart) {
+            n = read(fd, ring + wr%RING_SIZE, MIN(space, sizeof junk));
+            if (n>0) __atomic_store_n(&wr, wr+n, __ATOMIC_RELEASE);
+            full = false;
+        }
+        else if (npart && space>=uint64_t(npart)) { // rest of the sample follows in the ring
+            memcpy(ring + wr%RING_SIZE, part, npart);
+            __atomic_store_n(&wr, wr+npart, __ATOMIC_RELEASE);
+            n = npart;
+            npart = 0;
+            full = false;
+        }
+        else { // overrun: keep the producer moving, count what we lose in whole samples
+            memcpy(junk, part, npart);
+            n = read(fd, junk+npart, sizeof junk - npart);
+            if (n>0) {
+                int got = npart+n, drop = got - got%frame;
+                npart = got - drop;
+                memcpy(part, junk+drop, npart);
+                if (!full) __atomic_store_n(&overruns, overruns+1, __ATOMIC_RELAXED);
+                __atomic_store_n(&dropped, dropped+drop, __ATOMIC_RELAXED);
+                full = true;
+            }
+        }
+
+        if (n==0 || (n<0 && errno!=EINTR)) break;
+    }
+
+    __atomic_store_n(&eof, true, __ATOMIC_RELEASE);
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////
+
+int SOURCE::SeekSample(int64_t n) {
+    if (n<0 || size_t(n*bits/8)>=size) return -1;
+    if (stream && size_t(n*bits/8)<pos) return -1;
+    pos = n*bits/8;
+    return 0;
+}
+
+int SOURCE::SeekTime(double t) {
+    return SeekSample(int64_t(t*FS));
+}
+
+void SOURCE::SetEnd(double t) {
+    end = size;
+    if (t>0 && t*FS*bits/8<size) end = size_t(t*FS*bits/8);
+}
+
+void SOURCE::Mark() {
+    mark = pos;
+}
+
+void SOURCE::Rewind() {
+    pos = mark;
+    mark = SIZE_MAX;
+}
+
+double SOURCE::Time() { // streams: samples received, not counting dropped ones
+    return pos*8.0/bits/FS;
+}
+
+double SOURCE::Dropped() {
+    return __atomic_load_n(&dropped, __ATOMIC_RELAXED)*8.0/bits;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////
+
+const unsigned char *SOURCE::View(size_t len, size_t adv) {
+    size_t need = MAX(len, adv);
+    if (pos+need > end) return NULL;
+
+    if (stream) {
+        for (;;) {
+            uint64_t w = __atomic_load_n(&wr, __ATOMIC_ACQUIRE);
+            uint64_t r = MIN(MIN(uint64_t(pos), uint64_t(mark)), w); // previous view, and anything skipped, is done with
+            if (r>rd) __atomic_store_n(&rd, r, __ATOMIC_RELEASE);
+            if (w >= pos+need) break;
+            if (__atomic_load_n(&eof, __ATOMIC_ACQUIRE) && w==__atomic_load_n(&wr, __ATOMIC_ACQUIRE)) return NULL;
+            usleep(1000);
+        }
+        const unsigned char *p = base + pos%RING_SIZE;
+        pos += adv;
+        return p;
+    }
+
+    const unsigned char *p = base+pos;
+    pos += adv;
+    return p;
+}
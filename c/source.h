@@ -0,0 +1,52 @@
+///////////////////////////////////////////////////////////////////////////////////////////////
+// Homemade GPS Receiver
+// Copyright (c) Andrew Holme 2011-2013
+// http://www.holmea.demon.co.uk/GPS/Main.htm
+///////////////////////////////////////////////////////////////////////////////////////////////
+
+#include <stddef.h>
+#include <stdint.h>
+#include <pthread.h>
+
+///////////////////////////////////////////////////////////////////////////////////////////////
+// Sample source, consumed through read-only views.  Positions are in bytes;
+// samples are bits wide, packed LSB first if < 8.
+//
+// Files are mapped whole.  Pipes, FIFOs ("-" = stdin) and TCP ("tcp:host:port")
+// stream through a ring filled by a reader thread, which never blocks on us:
+// when the ring is full it keeps reading and counts what it throws away.
+
+#ifndef RING_SIZE
+#define RING_SIZE (64<<20) // Stream ring, bytes, multiple of page size
+#endif
+
+struct SOURCE {
+    const unsigned char *base;      // Mapping: file, or ring mapped twice back to back
+    size_t size;                    // Bytes in file
+    size_t pos, end;                // Read position; end of search window
+    size_t mark;                    // Rewind point, SIZE_MAX = none: streams hold the ring from here
+    int bits;                       // Per sample
+
+    bool stream;                    // Ring fields below
+    int fd;
+    pthread_t thread;
+    uint64_t wr, rd;                // Bytes written by reader thread; released by us
+    uint64_t overruns, dropped;     // Ring-full episodes; bytes thrown away, whole samples
+    bool eof;
+
+    int  Open(const char *filename, int bits);
+    void Close();
+
+    int  SeekSample(int64_t n);     // Rounds down to a whole byte if bits < 8; streams: forward only
+    int  SeekTime(double t);        // Seconds from start of capture
+    void SetEnd(double t);          // Stop at t seconds, 0 = end of capture
+    void Mark();                    // Remember pos ...
+    void Rewind();                  // ... and go back to it, also on streams
+
+    const unsigned char *View(size_t len, size_t adv); // len bytes at pos, then skip adv; NULL at end
+    double Time();                  // Seconds at pos
+    double Dropped();               // Samples thrown away so far
+
+    int  OpenStream(int fd);
+    void Reader();
+};
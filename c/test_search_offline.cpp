@@ -8,12 +8,36 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fftw3.h>
 
 double FC, FS, max_fo;
+int snapshot;
+int threads;
+int trackers;
+int channels;
+int batch = 4;
+int noncoh = 1;
+int coarse;
+double start_time, duration;
+char *cache_dir;
+unsigned planner = FFTW_ESTIMATE;
+char *prns;
+char *aid_file, *aid_time;
+double aid_lat, aid_lon, aid_alt;
+double aid_window = 1000;
+double aid_mask = 5;
+char *warm_file;
 #include "gps_offline.h"
+#include "perf.h"
+
+FORMAT format = FMT_1BIT;
 
 int main(int argc, char *argv[]) {
-    int ret;
+    int ret, opt;
+    double stats=0;
+    int receive=0;
 
     char filename[256];
     sprintf(filename, "%s", "gps.samples.1bit.I.fs5456.if4092.bin");
@@ -24,26 +48,112 @@ int main(int argc, char *argv[]) {
     printf("GPS CA code offline search. Extract from http://www.aholme.co.uk/GPS/Main.htm\n");
     printf("Jiao Xianjun (putaoshu@gmail.com). 2014-05.\n");
     printf("usage:\n");
-    printf("gps_test   filename_of_1bit_IF_cap   carrier_freq   sampling_rate   max_freq_offset\n");
+    printf("gps_test [options] filename_of_1bit_IF_cap   carrier_freq   sampling_rate   max_freq_offset\n");
     printf("or\n");
-    printf("gps_test (Make sure gps.samples.1bit.I.fs5456.if4092.bin can be found. Download http://www.jks.com/gps/gps.html)\n");
+    printf("gps_test [options] (Make sure gps.samples.1bit.I.fs5456.if4092.bin can be found. Download http://www.jks.com/gps/gps.html)\n");
+    printf("filename may also be - (stdin), a FIFO or tcp:host:port to search a live stream\n");
+    printf("options:\n");
+    printf("  -s       search all satellites in one sample capture (common timestamp)\n");
+    printf("  -j N     use N acquisition threads (default: one per core)\n");
+    printf("  -k K     inverse FFT K Doppler bins at a time (default: 4; K*%d*8 bytes each, fit to L2/L3)\n", FFT_LEN);
+    printf("  -n N     sum |correlation|^2 over N consecutive blocks for weak signals (default: 1)\n");
+    printf("  -f       coarse search at ~2 samples/chip, then refine the peak at full rate\n");
+    printf("  -F FMT   capture format: 1bit (default), 2bit, rtl, hackrf or int16\n");
+    printf("  -t SEC   start searching SEC seconds into the capture\n");
+    printf("  -d SEC   search only SEC seconds of the capture\n");
+    printf("  -c DIR   keep code spectra and FFTW wisdom in DIR for fast restarts\n");
+    printf("  -p MODE  FFTW planner effort: estimate (default), measure or patient\n");
+    printf("  -P LIST  PRNs to search, e.g. 1-32,120-158; gps (1-32, default), sbas (120-158) or all\n");
+    printf("  -A FILE  assisted search: RINEX 2/3 navigation file of GPS ephemerides\n");
+    printf("  -L POS   approximate position lat,lon,alt (degrees, degrees, metres) for -A\n");
+    printf("  -T TIME  GPS time of capture start for -A and -w: YYYY-MM-DDTHH:MM:SS UTC or seconds of week (default: now, -w: file time)\n");
+    printf("  -W HZ    assisted or warm-start Doppler search either side of prediction (default: 1000)\n");
+    printf("  -E DEG   assisted elevation mask (default: 5)\n");
+    printf("  -w FILE  warm start: search near each PRN's last Doppler in FILE first, then update it\n");
+    printf("  -r       receive: track what the search finds and solve for position along the capture\n");
+    printf("  -J N     with -r, run the channels on N tracker threads (default: one per core)\n");
+    printf("  -C N     with -r, track up to N satellites at once (default: %d)\n", NUM_CHANS);
+    printf("  -S SEC   print per-stage counters to stderr every SEC seconds and at exit (always on SIGUSR1)\n");
+
+    while ((opt = getopt(argc, argv, "sfrj:J:C:k:n:F:t:d:c:p:P:A:L:T:W:E:w:S:")) != -1) {
+      switch (opt) {
+        case 's': snapshot = 1; break;
+        case 'f': coarse = 1; break;
+        case 'r': receive = 1; break;
+        case 'j': threads = atoi(optarg); break;
+        case 'J': trackers = atoi(optarg); break;
+        case 'C': channels = atoi(optarg); break;
+        case 'k': batch = atoi(optarg); break;
+        case 'n': noncoh = atoi(optarg); break;
+        case 'F':
+          if      (0==strcmp(optarg, "1bit"))   format = FMT_1BIT;
+          else if (0==strcmp(optarg, "2bit"))   format = FMT_2BIT;
+          else if (0==strcmp(optarg, "rtl"))    format = FMT_RTL;
+          else if (0==strcmp(optarg, "hackrf")) format = FMT_HACKRF;
+          else if (0==strcmp(optarg, "int16"))  format = FMT_INT16;
+          else {
+            printf("Unknown format %s!\n", optarg);
+            return(0);
+          }
+          break;
+        case 't': start_time = atof(optarg); break;
+        case 'd': duration = atof(optarg); break;
+        case 'c': cache_dir = optarg; break;
+        case 'P': prns = optarg; break;
+        case 'A': aid_file = optarg; break;
+        case 'L':
+          if (sscanf(optarg, "%lf,%lf,%lf", &aid_lat, &aid_lon, &aid_alt) < 2) {
+            printf("Bad position %s!\n", optarg);
+            return(0);
+          }
+          break;
+        case 'T': aid_time = optarg; break;
+        case 'W': aid_window = atof(optarg); break;
+        case 'E': aid_mask = atof(optarg); break;
+        case 'w': warm_file = optarg; break;
+        case 'S': stats = atof(optarg); break;
+        case 'p':
+          if      (0==strcmp(optarg, "estimate")) planner = FFTW_ESTIMATE;
+          else if (0==strcmp(optarg, "measure"))  planner = FFTW_MEASURE;
+          else if (0==strcmp(optarg, "patient"))  planner = FFTW_PATIENT;
+          else {
+            printf("Unknown planner %s!\n", optarg);
+            return(0);
+          }
+          break;
+        default:
+          printf("Unknown option!\n");
+          return(0);
+      }
+    }
+    argc -= optind-1;
+    argv += optind-1;
 
     if (argc == 5) {
       sprintf(filename, "%s", argv[1]);
       FC = atof(argv[2]);
       FS = atof(argv[3]);
+      max_fo = atof(argv[4]);
     }else if (argc != 1) {
-      printf("Please run with 3 arguments or without argument!\n");
+      printf("Please run with 4 arguments or without argument!\n");
       return(0);
     }
 
+    PerfInit(stats); // before SearchInit starts the workers
+
     ret = SearchInit();
     if (ret) {
         printf("SearchInit() returned %d\n", ret);
         return ret;
     }
 
-    SearchTask(filename);
+    if (receive)
+        ReceiveTask(filename);
+    else
+        SearchTask(filename);
+    SearchFree();
+
+    if (stats>0) PerfDump(stderr);
 
     return(0);
 }